@@ -32,6 +32,9 @@
 #include <sys/time.h>
 #include <utime.h>
 #include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
 
 #include "global.h"
 
@@ -90,17 +93,64 @@ struct _GUIside
 					     const guchar *string);
 
 	int		abort_attempts;
+
+	GString		*incoming;	/* Partial record from the child */
+	GHashTable	*checks;	/* Directory -> set of leafnames to update */
+};
+
+/* An item found by for_dir_contents(). Worker threads lstat() it (and list
+ * it, if it's a directory) while we're still dealing with earlier items.
+ */
+typedef struct _WalkEntry WalkEntry;
+
+struct _WalkEntry {
+	gchar		*path;		/* For messages */
+	const gchar	*leaf;		/* (points into path) */
+	int		dir_fd;		/* Containing directory, or -1 */
+	gboolean	may_list;	/* 'quiet' when queued */
+	gboolean	done;		/* Worker finished (under walk_lock) */
+	gboolean	used;		/* action_lstat() has returned info */
+	struct stat	*info;		/* NULL if lstat() failed */
+	int		lstat_errno;
+	GPtrArray	*names;		/* Leafnames, for a readable dir */
 };
 
+#if defined(HAVE_OPENAT) && defined(HAVE_FDOPENDIR)
+/* Work on items relative to their directory's file descriptor, so the
+ * kernel doesn't have to look up the whole path each time (and so that
+ * renaming a parent directory doesn't change what we're working on).
+ */
+# define USE_AT_FUNCS
+#endif
+
+#define MAX_WALK_THREADS 16
+#define WALK_AHEAD 256		/* Items to have queued ahead of us */
+#define WALK_LIST_AHEAD 4096	/* Names to have listed ahead of us */
+#define MAX_WALK_FDS 128	/* Directories to keep open while walking */
+
+/* The child sends records to the GUI in batches. Each record is a type
+ * character, the length of the text as a 24-bit big-endian number, and
+ * then the text (without a terminating nul).
+ */
+#define RECORD_HEADER 4
+#define MAX_RECORD 0xffffff
+#define BATCH_SIZE 0x8000	/* Write when this much is waiting */
+#define FLUSH_INTERVAL 100000	/* Or when it has waited this long (us) */
+#define BRIEF_LOG_INTERVAL 0.1	/* Seconds between lines in brief mode */
+
 /* These don't need to be in a structure because we fork() before
  * using them again.
  */
 static gboolean mount_open_dir = FALSE;
 static gboolean mount_mount = FALSE;	/* (FALSE => unmount) */
 static int 	from_parent = 0;
-static FILE	*to_parent = NULL;
+static int	to_parent = -1;
 static gboolean	quiet = FALSE;
 static GString  *message = NULL;
+static GString	*outgoing = NULL;	/* Records not yet sent */
+static GMutex	*send_lock = NULL;	/* NULL => no flush thread */
+static GTimer	*send_timer = NULL;
+static double	last_brief_log = -1;	/* For brief_log_wanted() */
 static const char *action_dest = NULL;
 static const char *action_leaf = NULL;
 static void (*action_do_func)(const char *source, const char *dest);
@@ -112,6 +162,15 @@ static struct mode_change *mode_change = NULL;	/* For Permissions */
 static FindCondition *find_condition = NULL;	/* For Find */
 static MIME_type *type_change = NULL;
 
+static GAsyncQueue *walk_queue = NULL;	/* NULL => no worker threads */
+static GMutex	*walk_lock = NULL;
+static GCond	*walk_done = NULL;	/* Signalled as each entry is done */
+static WalkEntry *walk_current = NULL;	/* Item being processed */
+static int	walk_listed = 0;	/* Names listed ahead (walk_lock) */
+static gboolean	walk_listing = FALSE;	/* A worker is listing (walk_lock) */
+static int	walk_fds = 0;		/* Directories open in for_dir_contents */
+static int	walk_max_fds = MAX_WALK_FDS;	/* (less if few fds allowed) */
+
 /* Only used by child */
 static gboolean o_force = FALSE;
 static gboolean o_brief = FALSE;
@@ -141,17 +200,34 @@ static guchar	*new_entry_string = NULL;
 
 /* Static prototypes */
 static void send_done(void);
+static void queue_check(GUIside *gui_side, const gchar *path);
 static void send_check_path(const gchar *path);
 static void send_mount_path(const gchar *path);
 static gboolean printf_send(const char *msg, ...);
 static gboolean send_msg(void);
+static gboolean write_outgoing(void);
+static void flush_to_parent(void);
+static void send_init(void);
+static gpointer flush_thread(gpointer data);
+static gboolean brief_log_wanted(void);
 static gboolean send_error(void);
 static gboolean send_dir(const char *dir);
-static gboolean read_exact(int source, char *buffer, ssize_t len);
 static void do_mount(const guchar *path, gboolean mount);
 static gboolean printf_reply(int fd, gboolean ignore_quiet,
 			     const char *msg, ...);
 static gboolean remove_pinned_ok(GList *paths);
+static void walk_init(void);
+static gpointer walk_thread(gpointer data);
+static GPtrArray *read_names(int dir_fd, const char *dir);
+static void free_names(GPtrArray *names);
+static GPtrArray *take_names(WalkEntry *entry);
+static void close_walk_fd(int dir_fd);
+static int entry_lstat(WalkEntry *entry, struct stat *info);
+static WalkEntry *current_entry(const char *path);
+static int action_lstat(const char *path, struct stat *info);
+static int action_remove(const char *path, gboolean is_dir);
+static int action_chmod(const char *path, mode_t mode);
+static int action_access(const char *path, int mode);
 
 /*			SUPPORT				*/
 
@@ -332,88 +408,163 @@ static void show_settype_help(gpointer data)
 	gtk_widget_show_all(help);
 }
 
-static void process_message(GUIside *gui_side, const gchar *buffer)
+static void process_message(GUIside *gui_side, gchar type, const gchar *text)
 {
 	ABox *abox = gui_side->abox;
 
-	if (*buffer == '?')
-		abox_ask(abox, buffer + 1);
-	else if (*buffer == 's')
-		dir_check_this(buffer + 1);	/* Update this item */
-	else if (*buffer == '=')
-		abox_add_filename(abox, buffer + 1);
-	else if (*buffer == '#')
+	if (type == '?')
+		abox_ask(abox, text);
+	else if (type == 's')
+		queue_check(gui_side, text);	/* Update this item */
+	else if (type == '=')
+		abox_add_filename(abox, text);
+	else if (type == '#')
 		abox_clear_results(abox);
-	else if (*buffer == 'X')
+	else if (type == 'X')
 	{
-		filer_close_recursive(buffer + 1);
+		filer_close_recursive(text);
 		/* Let child know it's safe to continue... */
 		fputc('X', gui_side->to_child);
 		fflush(gui_side->to_child);
 	}
-	else if (*buffer == 'm' || *buffer == 'M')
+	else if (type == 'm' || type == 'M')
 	{
 		/* Mount / major changes to this path */
-		if (*buffer == 'M')
+		if (type == 'M')
 		{
 			mount_update(TRUE);
-			mount_user_mount(buffer + 1);
+			mount_user_mount(text);
 		}
-		filer_check_mounted(buffer + 1);
+		filer_check_mounted(text);
 	}
-	else if (*buffer == '/')
-		abox_set_current_object(abox, buffer + 1);
-	else if (*buffer == 'o')
-		filer_opendir(buffer + 1, NULL, NULL);
-	else if (*buffer == '!')
+	else if (type == '/')
+		abox_set_current_object(abox, text);
+	else if (type == 'o')
+		filer_opendir(text, NULL, NULL);
+	else if (type == '!')
 	{
 		gui_side->errors++;
-		abox_log(abox, buffer + 1, "error");
+		abox_log(abox, text, "error");
 	}
-	else if (*buffer == '<') 
-		abox_set_file(abox, 0, buffer+1);
-	else if (*buffer == '>')
+	else if (type == '<') 
+		abox_set_file(abox, 0, text);
+	else if (type == '>')
 	{
-		abox_set_file(abox, 1, buffer+1);
+		abox_set_file(abox, 1, text);
 		abox_show_compare(abox, TRUE);
 	}
-	else if (*buffer == '%')
+	else if (type == '%')
 	{
-		abox_set_percentage(abox, atoi(buffer+1));
+		abox_set_percentage(abox, atoi(text));
 	}
 	else
-		abox_log(abox, buffer + 1, NULL);
+		abox_log(abox, text, NULL);
+}
+
+/* Remember to update this item once the current batch of messages has
+ * been processed. The child sends one of these for each item it changes.
+ */
+static void queue_check(GUIside *gui_side, const gchar *path)
+{
+	GHashTable *leaves;
+	gchar	*dir;
+
+	dir = g_path_get_dirname(path);
+	leaves = g_hash_table_lookup(gui_side->checks, dir);
+	if (leaves)
+		g_free(dir);
+	else
+	{
+		leaves = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, NULL);
+		g_hash_table_insert(gui_side->checks, dir, leaves);
+	}
+
+	if (!g_hash_table_lookup_extended(leaves, g_basename(path),
+					  NULL, NULL))
+		g_hash_table_insert(leaves, g_strdup(g_basename(path)), NULL);
+}
+
+static void add_leaf(gpointer key, gpointer value, gpointer data)
+{
+	g_ptr_array_add((GPtrArray *) data, key);
+}
+
+static gboolean check_dir(gpointer key, gpointer value, gpointer data)
+{
+	GPtrArray *leaves;
+
+	leaves = g_ptr_array_new();
+	g_hash_table_foreach((GHashTable *) value, add_leaf, leaves);
+	dir_check_leaves((guchar *) key, leaves);
+	g_ptr_array_free(leaves, TRUE);
+
+	return TRUE;
 }
 
-/* Called when the child sends us a message */
+/* Update the items from queue_check(), with one pass for each directory */
+static void do_checks(GUIside *gui_side)
+{
+	g_hash_table_foreach_remove(gui_side->checks, check_dir, NULL);
+}
+
+/* Process all the complete records in gui_side->incoming, leaving any
+ * partial one for next time.
+ */
+static void process_records(GUIside *gui_side)
+{
+	GString	*incoming = gui_side->incoming;
+	gsize	done = 0;
+
+	while (incoming->len - done >= RECORD_HEADER)
+	{
+		guchar	*header = (guchar *) incoming->str + done;
+		gsize	len;
+		gchar	*text;
+
+		len = (header[1] << 16) | (header[2] << 8) | header[3];
+		if (incoming->len - done - RECORD_HEADER < len)
+			break;
+
+		text = g_strndup((gchar *) header + RECORD_HEADER, len);
+		done += RECORD_HEADER + len;
+		process_message(gui_side, header[0], text);
+		g_free(text);
+	}
+
+	g_string_erase(incoming, 0, done);
+
+	do_checks(gui_side);
+}
+
+/* Called when the child sends us some messages */
 static void message_from_child(gpointer 	  data,
 			        gint     	  source, 
 			        GdkInputCondition condition)
 {
-	char buf[5];
 	GUIside	*gui_side = (GUIside *) data;
 	ABox	*abox = gui_side->abox;
+	GString	*incoming = gui_side->incoming;
+	gsize	old_len = incoming->len;
+	ssize_t	got;
 	GtkTextBuffer *text_buffer;
 
-	text_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(abox->log));
+	g_string_set_size(incoming, old_len + BATCH_SIZE);
+	got = read(source, incoming->str + old_len, BATCH_SIZE);
+	g_string_truncate(incoming, old_len + MAX(got, 0));
 
-	if (read_exact(source, buf, 4))
+	if (got > 0)
 	{
-		ssize_t message_len;
-		char	*buffer;
+		process_records(gui_side);
+		return;
+	}
+	if (got < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
 
-		buf[4] = '\0';
-		message_len = strtol(buf, NULL, 16);
-		buffer = g_malloc(message_len + 1);
-		if (message_len > 0 && read_exact(source, buffer, message_len))
-		{
-			buffer[message_len] = '\0';
-			process_message(gui_side, buffer);
-			g_free(buffer);
-			return;
-		}
+	if (incoming->len)
 		g_printerr("Child died in the middle of a message.\n");
-	}
+
+	text_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(abox->log));
 
 	if (gui_side->abort_attempts)
 		abox_log(abox, _("\nProcess terminated.\n"), "error");
@@ -450,53 +601,367 @@ static void for_dir_contents(ForDirCB *cb,
 			     const char *src_dir,
 			     const char *dest_path)
 {
-	DIR	*d;
-	struct dirent *ent;
-	GList  *list = NULL, *next;
+	GPtrArray	*names = NULL;
+	WalkEntry	*entries, *saved = walk_current;
+	WalkEntry	*parent = current_entry(src_dir);
+	int		i, n, queued = 0;
+	int		dir_fd = -1;
 
-	d = mc_opendir(src_dir);
-	if (!d)
+	walk_init();
+
+#ifdef USE_AT_FUNCS
+	/* Each level keeps its directory open while we're inside it, so
+	 * stop using descriptors when the tree gets very deep, and work with
+	 * paths instead (as we also do if the directory can't be opened).
+	 */
+	if (walk_fds < walk_max_fds)
+	{
+		if (parent && parent->dir_fd != -1)
+			dir_fd = openat(parent->dir_fd, parent->leaf,
+					O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+		else
+			dir_fd = open(src_dir, O_RDONLY | O_DIRECTORY);
+	}
+	if (dir_fd != -1)
+		walk_fds++;
+#endif
+
+	/* A worker may have listed src_dir already */
+	if (parent)
+		names = take_names(parent);
+	if (!names)
+		names = read_names(dir_fd, src_dir);
+
+	if (!names)
 	{
 		/* Message displayed is "ERROR reading 'path': message" */
 		printf_send("!%s '%s': %s\n", _("ERROR reading"),
 			    src_dir, g_strerror(errno));
+		close_walk_fd(dir_fd);
 		return;
 	}
 
 	send_dir(src_dir);
 
+	n = names->len;
+	entries = g_new0(WalkEntry, n);
+	for (i = 0; i < n; i++)
+	{
+		entries[i].path = g_build_filename(src_dir,
+						   names->pdata[i], NULL);
+		entries[i].leaf = g_basename(entries[i].path);
+		entries[i].dir_fd = dir_fd;
+	}
+	free_names(names);
+
+	/* The workers only look at things; the callback does everything
+	 * else, in order, exactly as if it were doing all the work itself.
+	 */
+	for (i = 0; i < n; i++)
+	{
+		WalkEntry *entry = &entries[i];
+
+		if (walk_queue)
+		{
+			/* 'quiet' may change while we wait for the user,
+			 * so tell the worker what it was now.
+			 */
+			while (queued < n && queued < i + WALK_AHEAD)
+			{
+				entries[queued].may_list = quiet;
+				g_async_queue_push(walk_queue,
+						   &entries[queued++]);
+			}
+
+			g_mutex_lock(walk_lock);
+			while (!entry->done)
+				g_cond_wait(walk_done, walk_lock);
+			g_mutex_unlock(walk_lock);
+		}
+
+		walk_current = entry;
+		cb(entry->path, dest_path);
+		walk_current = saved;
+
+		g_free(entry->path);
+		g_free(entry->info);
+		names = take_names(entry);
+		if (names)
+			free_names(names);
+	}
+
+	g_free(entries);
+
+	close_walk_fd(dir_fd);
+}
+
+/* Start the worker threads for for_dir_contents(), if we can.
+ * We're in the action child, so we can't use a GThreadPool: it may try
+ * to reuse idle threads which only exist in the parent.
+ */
+static void walk_init(void)
+{
+	static gboolean	initialised = FALSE;
+	struct rlimit	limit;
+	long		n_cpus;
+	int		i, n_threads;
+
+	if (initialised)
+		return;
+	initialised = TRUE;
+
+	/* Leave most of our file descriptors for everything else */
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+	    limit.rlim_cur != RLIM_INFINITY)
+		walk_max_fds = MIN(MAX_WALK_FDS, limit.rlim_cur / 4);
+
+	if (!g_thread_supported())
+		return;
+
+	/* Mostly waiting for the disk or network, so use extra threads */
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	n_threads = CLAMP(n_cpus * 2, 2, MAX_WALK_THREADS);
+
+	walk_lock = g_mutex_new();
+	walk_done = g_cond_new();
+	walk_queue = g_async_queue_new();
+
+	for (i = 0; i < n_threads; i++)
+	{
+		if (!g_thread_create(walk_thread, NULL, FALSE, NULL))
+			break;
+	}
+
+	if (i == 0)
+		walk_queue = NULL;	/* (leak it; it's empty) */
+}
+
+/* Worker thread. Only makes system calls; never talks to the parent */
+static gpointer walk_thread(gpointer data)
+{
+	for (;;)
+	{
+		WalkEntry	*entry;
+		struct stat	info;
+		struct stat	*copy = NULL;
+		GPtrArray	*names = NULL;
+		gboolean	list = FALSE;
+		int		err = 0;
+
+		entry = g_async_queue_pop(walk_queue);
+
+		if (entry_lstat(entry, &info))
+			err = errno;
+		else
+		{
+			copy = g_memdup(&info, sizeof(info));
+
+			/* If we're going to ask about the directory first,
+			 * the listing could be out of date by the time we
+			 * get to use it. Listings are kept until their
+			 * directory is reached, so only one is made at a time
+			 * and we stop when WALK_LIST_AHEAD names are waiting.
+			 */
+			if (S_ISDIR(info.st_mode) && entry->may_list)
+			{
+				g_mutex_lock(walk_lock);
+				list = !walk_listing &&
+					walk_listed < WALK_LIST_AHEAD;
+				if (list)
+					walk_listing = TRUE;
+				g_mutex_unlock(walk_lock);
+			}
+
+			if (list)
+			{
+				int fd = -1;
+
+#ifdef USE_AT_FUNCS
+				if (entry->dir_fd != -1)
+					fd = openat(entry->dir_fd, entry->leaf,
+						O_RDONLY | O_DIRECTORY |
+						O_NOFOLLOW);
+#endif
+				names = read_names(fd, entry->path);
+				if (fd != -1)
+					close(fd);
+			}
+		}
+
+		g_mutex_lock(walk_lock);
+		entry->info = copy;
+		entry->lstat_errno = err;
+		entry->names = names;
+		if (list)
+			walk_listing = FALSE;
+		if (names)
+			walk_listed += names->len;
+		entry->done = TRUE;
+		g_cond_broadcast(walk_done);
+		g_mutex_unlock(walk_lock);
+	}
+
+	return NULL;
+}
+
+/* Returns the leafnames in 'dir' (not . and ..), or NULL with errno set.
+ * If dir_fd isn't -1 then it is an open descriptor for 'dir' to read
+ * instead (it isn't closed). Free the result with free_names().
+ */
+static GPtrArray *read_names(int dir_fd, const char *dir)
+{
+	DIR	*d = NULL;
+	struct dirent *ent;
+	GPtrArray *names;
+
+#ifdef USE_AT_FUNCS
+	if (dir_fd != -1)
+	{
+		int fd;
+
+		fd = dup(dir_fd);
+		if (fd != -1)
+		{
+			d = fdopendir(fd);
+			if (!d)
+				close(fd);
+		}
+	}
+#endif
+	if (!d)
+		d = mc_opendir(dir);	/* No fd, or out of fds */
+	if (!d)
+		return NULL;
+
+	names = g_ptr_array_new();
 	while ((ent = mc_readdir(d)))
 	{
 		if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0'
 			|| (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
 			continue;
-		list = g_list_prepend(list, g_strdup(make_path(src_dir,
-							       ent->d_name)));
+		g_ptr_array_add(names, g_strdup(ent->d_name));
 	}
 	mc_closedir(d);
 
-	for (next = list; next; next = next->next)
-	{
-		cb((char *) next->data, dest_path);
+	return names;
+}
 
-		g_free(next->data);
-	}
-	g_list_free(list);
+static void free_names(GPtrArray *names)
+{
+	int	i;
+
+	for (i = 0; i < names->len; i++)
+		g_free(names->pdata[i]);
+	g_ptr_array_free(names, TRUE);
 }
 
-/* Read this many bytes into the buffer. TRUE on success. */
-static gboolean read_exact(int source, char *buffer, ssize_t len)
+/* Remove and return the listing a worker made for this entry, if any.
+ * The entry must be done.
+ */
+static GPtrArray *take_names(WalkEntry *entry)
 {
-	while (len > 0)
+	GPtrArray *names = entry->names;
+
+	if (!names)
+		return NULL;
+
+	g_mutex_lock(walk_lock);
+	entry->names = NULL;
+	walk_listed -= names->len;
+	g_mutex_unlock(walk_lock);
+
+	return names;
+}
+
+static void close_walk_fd(int dir_fd)
+{
+	if (dir_fd == -1)
+		return;
+
+	close(dir_fd);
+	walk_fds--;
+}
+
+static int entry_lstat(WalkEntry *entry, struct stat *info)
+{
+#ifdef USE_AT_FUNCS
+	if (entry->dir_fd != -1)
+		return fstatat(entry->dir_fd, entry->leaf, info,
+				AT_SYMLINK_NOFOLLOW);
+#endif
+	return mc_lstat(entry->path, info);
+}
+
+/* The item for_dir_contents() is processing, if it is 'path' */
+static WalkEntry *current_entry(const char *path)
+{
+	if (walk_current && strcmp(walk_current->path, path) == 0)
+		return walk_current;
+	return NULL;
+}
+
+/* The action_*() functions act on 'path', but if it's the item being
+ * processed then they work relative to its directory instead.
+ */
+
+/* Like mc_lstat(), but uses the result a worker got for the current item.
+ * Only the first call gets this; after that the item may have changed.
+ */
+static int action_lstat(const char *path, struct stat *info)
+{
+	WalkEntry *entry = current_entry(path);
+
+	if (!entry)
+		return mc_lstat(path, info);
+
+	if (entry->done && !entry->used)
 	{
-		ssize_t got;
-		got = read(source, buffer, len);
-		if (got < 1)
-			return FALSE;
-		len -= got;
-		buffer += got;
+		entry->used = TRUE;
+		if (!entry->info)
+		{
+			errno = entry->lstat_errno;
+			return -1;
+		}
+		*info = *entry->info;
+		return 0;
 	}
-	return TRUE;
+
+	return entry_lstat(entry, info);
+}
+
+/* rmdir() or unlink() */
+static int action_remove(const char *path, gboolean is_dir)
+{
+#ifdef USE_AT_FUNCS
+	WalkEntry *entry = current_entry(path);
+
+	if (entry && entry->dir_fd != -1)
+		return unlinkat(entry->dir_fd, entry->leaf,
+				is_dir ? AT_REMOVEDIR : 0);
+#endif
+	return is_dir ? rmdir(path) : unlink(path);
+}
+
+static int action_chmod(const char *path, mode_t mode)
+{
+#ifdef USE_AT_FUNCS
+	WalkEntry *entry = current_entry(path);
+
+	if (entry && entry->dir_fd != -1)
+		return fchmodat(entry->dir_fd, entry->leaf, mode, 0);
+#endif
+	return chmod(path, mode);
+}
+
+static int action_access(const char *path, int mode)
+{
+#ifdef USE_AT_FUNCS
+	WalkEntry *entry = current_entry(path);
+
+	if (entry && entry->dir_fd != -1)
+		return faccessat(entry->dir_fd, entry->leaf, mode, 0);
+#endif
+	return access(path, mode);
 }
 
 static void send_done(void)
@@ -534,19 +999,129 @@ static gboolean printf_send(const char *msg, ...)
 	return send_msg();
 }
 
-/* Send 'message' to our parent process. TRUE on success. */
+/* Send 'message' to our parent process. TRUE on success.
+ * The record is added to the current batch, which is written out when it
+ * gets large or by the flush thread. Without a flush thread, only
+ * check-path records are held back. Use flush_to_parent() before waiting
+ * for a reply.
+ */
 static gboolean send_msg(void)
 {
-	char len_buffer[5];
-	ssize_t len;
+	guchar	header[RECORD_HEADER];
+	gsize	len;
+	gchar	type;
+	gboolean ok = TRUE;
+
+	g_return_val_if_fail(message->len > 0, FALSE);
+	g_return_val_if_fail(message->len <= MAX_RECORD, FALSE);
+
+	type = message->str[0];
+	len = message->len - 1;
+	header[0] = type;
+	header[1] = (len >> 16) & 0xff;
+	header[2] = (len >> 8) & 0xff;
+	header[3] = len & 0xff;
+
+	if (send_lock)
+		g_mutex_lock(send_lock);
+
+	g_string_append_len(outgoing, (gchar *) header, RECORD_HEADER);
+	g_string_append_len(outgoing, message->str + 1, len);
+
+	if (outgoing->len >= BATCH_SIZE || (!send_lock && type != 's'))
+		ok = write_outgoing();
+
+	if (send_lock)
+		g_mutex_unlock(send_lock);
+
+	return ok;
+}
+
+/* Write the batch to the parent. Call with send_lock held, if any. */
+static gboolean write_outgoing(void)
+{
+	const gchar *data = outgoing->str;
+	gsize	left = outgoing->len;
+
+	while (left > 0)
+	{
+		ssize_t	got;
+
+		got = write(to_parent, data, left);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got < 1)
+		{
+			g_string_truncate(outgoing, 0);
+			return FALSE;
+		}
+		data += got;
+		left -= got;
+	}
 
-	g_return_val_if_fail(message->len < 0xffff, FALSE);
+	g_string_truncate(outgoing, 0);
+	return TRUE;
+}
 
-	sprintf(len_buffer, "%04" G_GSIZE_MODIFIER "x", message->len);
-	fwrite(len_buffer, 1, 4, to_parent);
-	len = fwrite(message->str, 1, message->len, to_parent);
-	fflush(to_parent);
-	return len == (ssize_t) message->len;
+/* Send any records still waiting */
+static void flush_to_parent(void)
+{
+	if (send_lock)
+		g_mutex_lock(send_lock);
+	write_outgoing();
+	if (send_lock)
+		g_mutex_unlock(send_lock);
+}
+
+/* Called in the child after forking. Starts the thread which sends
+ * waiting records every FLUSH_INTERVAL, so that messages from before a
+ * long operation (eg, copying a large file) aren't held up.
+ */
+static void send_init(void)
+{
+	outgoing = g_string_new(NULL);
+	send_timer = g_timer_new();
+
+	if (!g_thread_supported())
+		return;
+
+	send_lock = g_mutex_new();
+	if (!g_thread_create(flush_thread, NULL, FALSE, NULL))
+		send_lock = NULL;	/* (leak it) */
+}
+
+static gpointer flush_thread(gpointer data)
+{
+	for (;;)
+	{
+		g_usleep(FLUSH_INTERVAL);
+
+		g_mutex_lock(send_lock);
+		if (outgoing->len)
+			write_outgoing();
+		g_mutex_unlock(send_lock);
+	}
+
+	return NULL;
+}
+
+/* In brief mode, we still log each directory, but not more than one every
+ * BRIEF_LOG_INTERVAL. Otherwise, deleting a large tree produces more log
+ * lines than the GUI can keep up with.
+ */
+static gboolean brief_log_wanted(void)
+{
+	double	now;
+
+	if (!o_brief)
+		return TRUE;
+
+	now = g_timer_elapsed(send_timer, NULL);
+	if (now - last_brief_log < BRIEF_LOG_INTERVAL)
+		return FALSE;
+
+	last_brief_log = now;
+	return TRUE;
 }
 
 /* Set the directory indicator at the top of the window */
@@ -697,6 +1272,7 @@ static gboolean printf_reply(int fd, gboolean ignore_quiet,
 	g_free(tmp);
 
 	send_msg();
+	flush_to_parent();
 
 	while (1)
 	{
@@ -762,6 +1338,8 @@ static void destroy_action_window(GtkWidget *widget, gpointer data)
 		g_source_remove(gui_side->input_tag);
 	}
 
+	g_string_free(gui_side->incoming, TRUE);
+	g_hash_table_destroy(gui_side->checks);
 	g_free(gui_side);
 	
 	one_less_window();
@@ -829,10 +1407,12 @@ static GUIside *start_action(GtkWidget *abox, ActionChild *func, gpointer data,
 			message = g_string_new(NULL);
 			close(filedes[0]);
 			close(filedes[3]);
-			to_parent = fdopen(filedes[1], "wb");
+			to_parent = filedes[1];
 			from_parent = filedes[2];
+			send_init();
 			func(data);
 			send_dir("");
+			flush_to_parent();
 			_exit(0);
 	}
 
@@ -848,6 +1428,9 @@ static GUIside *start_action(GtkWidget *abox, ActionChild *func, gpointer data,
 	gui_side->default_string = NULL;
 	gui_side->entry_string_func = NULL;
 	gui_side->abort_attempts = 0;
+	gui_side->incoming = g_string_new(NULL);
+	gui_side->checks = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, (GDestroyNotify) g_hash_table_destroy);
 
 	gui_side->abox = ABOX(abox);
 	g_signal_connect(abox, "destroy",
@@ -878,7 +1461,7 @@ static void do_usage(const char *src_path, const char *unused)
 
 	check_flags();
 
-	if (mc_lstat(src_path, &info))
+	if (action_lstat(src_path, &info))
 	{
 		printf_send("'%s:\n", src_path);
 		send_error();
@@ -913,14 +1496,14 @@ static void do_delete(const char *src_path, const char *unused)
 
 	check_flags();
 
-	if (mc_lstat(src_path, &info))
+	if (action_lstat(src_path, &info))
 	{
 		send_error();
 		return;
 	}
 
 	write_prot = S_ISLNK(info.st_mode) ? FALSE
-					   : access(src_path, W_OK) != 0;
+					   : action_access(src_path, W_OK) != 0;
 	if (write_prot || !quiet)
 	{
 		int res;
@@ -943,16 +1526,18 @@ static void do_delete(const char *src_path, const char *unused)
 	if (S_ISDIR(info.st_mode))
 	{
 		for_dir_contents(do_delete, safe_path, safe_path);
-		if (rmdir(safe_path))
+		if (action_remove(safe_path, TRUE))
 		{
 			g_free(safe_path);
 			send_error();
 			return;
 		}
-		printf_send(_("'Directory '%s' deleted\n"), safe_path);
+		if (brief_log_wanted())
+			printf_send(_("'Directory '%s' deleted\n"),
+					safe_path);
 		send_mount_path(safe_path);
 	}
-	else if (unlink(src_path))
+	else if (action_remove(src_path, FALSE))
 		send_error();
 	else
 	{
@@ -997,6 +1582,7 @@ static void do_eject(const char *path)
 	{
 		char c = '?';
 		printf_send("X%s", path);
+		flush_to_parent();
 		/* Wait until it's safe... */
 		read(from_parent, &c, 1);
 		g_return_if_fail(c == 'X');
@@ -1050,7 +1636,7 @@ static void do_find(const char *path, const char *unused)
 			return;
 	}
 
-	if (mc_lstat(path, &info.stats))
+	if (action_lstat(path, &info.stats))
 	{
 		send_error();
 		printf_send(_("'(while checking '%s')\n"), path);
@@ -1113,7 +1699,7 @@ static void do_chmod(const char *path, const char *unused)
 
 	check_flags();
 
-	if (mc_lstat(path, &info))
+	if (action_lstat(path, &info))
 	{
 		send_error();
 		return;
@@ -1156,7 +1742,7 @@ static void do_chmod(const char *path, const char *unused)
 			return;
 	}
 
-	if (mc_lstat(path, &info))
+	if (action_lstat(path, &info))
 	{
 		send_error();
 		return;
@@ -1165,7 +1751,7 @@ static void do_chmod(const char *path, const char *unused)
 		return;
 
 	new_mode = mode_adjust(info.st_mode, mode_change);
-	if (chmod(path, new_mode))
+	if (action_chmod(path, new_mode))
 	{
 		send_error();
 		return;
@@ -1193,7 +1779,7 @@ static void do_settype(const char *path, const char *unused)
 
 	check_flags();
 
-	if (mc_lstat(path, &info))
+	if (action_lstat(path, &info))
 	{
 		send_error();
 		return;
@@ -1235,7 +1821,7 @@ static void do_settype(const char *path, const char *unused)
 			return;
 	}
 
-	if (mc_lstat(path, &info))
+	if (action_lstat(path, &info))
 	{
 		send_error();
 		return;
@@ -1317,7 +1903,7 @@ static void do_copy2(const char *path, const char *dest)
 
 	dest_path = make_dest_path(path, dest);
 
-	if (mc_lstat(path, &info))
+	if (action_lstat(path, &info))
 	{
 		send_error();
 		return;
@@ -1370,7 +1956,7 @@ static void do_copy2(const char *path, const char *dest)
 				  _("?Copy %s as %s?"), path, dest_path))
 			return;
 	}
-	else if (!o_brief || S_ISDIR(info.st_mode))
+	else if (!o_brief || (S_ISDIR(info.st_mode) && brief_log_wanted()))
 		printf_send(_("'Copying %s as %s\n"), path, dest_path);
 
 	if (S_ISDIR(info.st_mode))
@@ -1471,10 +2057,9 @@ static void do_copy2(const char *path, const char *dest)
 static void do_move2(const char *path, const char *dest)
 {
 	const char	*dest_path;
-	const char	*argv[] = {"mv", "-f", NULL, NULL, NULL};
 	struct stat	info2;
 	gboolean	is_dir;
-	char            *err;
+	guchar		*err;
 
 	check_flags();
 
@@ -1531,10 +2116,7 @@ static void do_move2(const char *path, const char *dest)
 	else if (!o_brief)
 		printf_send(_("'Moving %s as %s\n"), path, dest_path);
 
-	argv[2] = path;
-	argv[3] = dest_path;
-
-	err = fork_exec_wait(argv);
+	err = move_file(path, dest_path);
 	if (err)
 	{
 		printf_send(_("!%s\nFailed to move %s as %s\n"),
@@ -1649,6 +2231,7 @@ static void do_mount(const guchar *path, gboolean mount)
 		 * can't unmount if dnotify is used.
 		 */
 		printf_send("X%s", path);
+		flush_to_parent();
 		/* Wait until it's safe... */
 		read(from_parent, &c, 1);
 		g_return_if_fail(c == 'X');
@@ -0,0 +1,179 @@
+/*
+ * ROX-Filer, filer for the ROX desktop project
+ * Copyright (C) 2006, Thomas Leonard and others (see changelog for details).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* arena.c - allocating lots of small objects which are freed together */
+
+/* A Directory may contain hundreds of thousands of DirItems, each with a
+ * leafname and a collate key. Allocating each of these with g_malloc() is
+ * slow and wastes memory, and freeing them all one at a time when the
+ * Directory goes is slow too.
+ *
+ * An Arena hands out memory from large blocks. Small objects are rounded
+ * up to a multiple of ARENA_ALIGN bytes. When freed, they go on a free list
+ * for their size, ready to be reused by the next allocation of that size.
+ * Large objects are just g_malloc()ed.
+ *
+ * arena_destroy() frees everything at once.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "global.h"
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_MAX_SMALL 1024		/* Larger objects use g_malloc() */
+#define ARENA_N_CLASSES (ARENA_MAX_SMALL / ARENA_ALIGN + 1)
+
+/* Each object is preceded by a header giving its size class (0 for large
+ * objects). The header is padded so that objects stay aligned.
+ */
+typedef union _ArenaHeader ArenaHeader;
+
+union _ArenaHeader {
+	gsize	size_class;
+	guchar	pad[ARENA_ALIGN];
+};
+
+/* A freed small object, waiting to be reused */
+typedef struct _ArenaFree ArenaFree;
+
+struct _ArenaFree {
+	ArenaFree *next;
+};
+
+struct _Arena {
+	GSList		*blocks;	/* Big blocks we carve objects from */
+	guchar		*next;		/* Free space in blocks->data */
+	gsize		space;		/* Bytes left at 'next' */
+
+	ArenaFree	*free[ARENA_N_CLASSES];
+	GHashTable	*large;		/* Headers of g_malloc()ed objects */
+};
+
+/****************************************************************
+ *			EXTERNAL INTERFACE			*
+ ****************************************************************/
+
+Arena *arena_new(void)
+{
+	Arena *arena;
+
+	arena = g_new0(Arena, 1);
+	arena->large = g_hash_table_new(NULL, NULL);
+
+	return arena;
+}
+
+static void free_large(gpointer key, gpointer value, gpointer data)
+{
+	g_free(key);
+}
+
+/* Free the arena and every object in it */
+void arena_destroy(Arena *arena)
+{
+	GSList *next;
+
+	g_return_if_fail(arena != NULL);
+
+	for (next = arena->blocks; next; next = next->next)
+		g_free(next->data);
+	g_slist_free(arena->blocks);
+
+	g_hash_table_foreach(arena->large, free_large, NULL);
+	g_hash_table_destroy(arena->large);
+
+	g_free(arena);
+}
+
+/* Like g_malloc(), but the memory comes from 'arena'. The contents are
+ * undefined. Free with arena_free() or arena_destroy().
+ */
+gpointer arena_alloc(Arena *arena, gsize size)
+{
+	ArenaHeader	*header;
+	gsize		size_class, needed;
+
+	g_return_val_if_fail(arena != NULL, NULL);
+
+	if (size > ARENA_MAX_SMALL)
+	{
+		header = g_malloc(sizeof(ArenaHeader) + size);
+		header->size_class = 0;
+		g_hash_table_insert(arena->large, header, header);
+		return header + 1;
+	}
+
+	size_class = MAX(1, (size + ARENA_ALIGN - 1) / ARENA_ALIGN);
+
+	if (arena->free[size_class])
+	{
+		ArenaFree *mem = arena->free[size_class];
+
+		arena->free[size_class] = mem->next;
+		return mem;
+	}
+
+	needed = sizeof(ArenaHeader) + size_class * ARENA_ALIGN;
+	if (needed > arena->space)
+	{
+		/* The rest of the old block is wasted (never more than
+		 * ARENA_MAX_SMALL bytes per block).
+		 */
+		arena->next = g_malloc(ARENA_BLOCK_SIZE);
+		arena->space = ARENA_BLOCK_SIZE;
+		arena->blocks = g_slist_prepend(arena->blocks, arena->next);
+	}
+
+	header = (ArenaHeader *) arena->next;
+	header->size_class = size_class;
+	arena->next += needed;
+	arena->space -= needed;
+
+	return header + 1;
+}
+
+/* Return an object to the arena. Small objects are kept for reuse. */
+void arena_free(Arena *arena, gpointer mem)
+{
+	ArenaHeader	*header;
+	ArenaFree	*free_mem = (ArenaFree *) mem;
+
+	g_return_if_fail(arena != NULL);
+	g_return_if_fail(mem != NULL);
+
+	header = ((ArenaHeader *) mem) - 1;
+
+	if (header->size_class == 0)
+	{
+		g_hash_table_remove(arena->large, header);
+		g_free(header);
+		return;
+	}
+
+	g_return_if_fail(header->size_class < ARENA_N_CLASSES);
+
+	free_mem->next = arena->free[header->size_class];
+	arena->free[header->size_class] = free_mem;
+}
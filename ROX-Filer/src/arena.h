@@ -0,0 +1,17 @@
+/*
+ * ROX-Filer, filer for the ROX desktop project
+ * Thomas Leonard, <tal197@users.sourceforge.net>
+ */
+
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <glib.h>
+
+Arena *arena_new(void);
+void arena_destroy(Arena *arena);
+gpointer arena_alloc(Arena *arena, gsize size);
+void arena_free(Arena *arena, gpointer mem);
+
+#endif /* _ARENA_H */
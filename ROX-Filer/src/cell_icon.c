@@ -38,6 +38,7 @@
 #include "type.h"
 #include "support.h"
 #include "fscache.h"
+#include "dir.h"
 
 typedef struct _CellIcon CellIcon;
 typedef struct _CellIconClass CellIconClass;
@@ -318,6 +319,11 @@ static void cell_icon_render(GtkCellRenderer    *cell,
 	size = get_style(cell);
 	color = &widget->style->base[icon->view_details->filer_window->selection_state];
 
+	/* Find out what it really is, now that someone's looking */
+	if (item->flags & ITEM_FLAG_NEED_SNIFF)
+		dir_queue_sniff(icon->view_details->filer_window->directory,
+				item);
+
 	/* Draw the icon */
 
 	if (!view_item->image)
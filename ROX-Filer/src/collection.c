@@ -25,6 +25,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
@@ -124,6 +125,14 @@ static void draw_lasso_box(Collection *collection);
 static void cancel_wink(Collection *collection);
 static gint collection_key_press(GtkWidget *widget, GdkEventKey *event);
 static void get_visible_limits(Collection *collection, int *first, int *last);
+static void draw_positions(Collection *collection, int from, int to,
+			   const SortKey *keys);
+static gboolean set_range_selected(Collection *collection,
+				   int start, int end, GdkFunction fn);
+static double item_size(Collection *collection, int item);
+static double count_size(Collection *collection, int item);
+static void emit_selection_signals(Collection *collection,
+				   guint old_selected, gboolean changed);
 static void scroll_to_show(Collection *collection, int item);
 static void collection_item_set_selected(Collection *collection,
                                          gint item,
@@ -318,6 +327,8 @@ static void collection_init(GTypeInstance *instance, gpointer g_class)
 	object->draw_item = default_draw_item;
 	object->test_point = default_test_point;
 	object->free_item = NULL;
+	object->item_size = NULL;
+	object->selected_size = 0;
 }
 
 GtkWidget* collection_new(void)
@@ -527,6 +538,133 @@ static void collection_get_item_area(Collection *collection,
 		area->width <<= 1;
 }
 
+/* Queue a redraw of the on-screen item positions from 'from' up to (but not
+ * including) 'to'. If 'keys' is given, positions whose keys[i].index is 'i'
+ * (ie, still showing the same item after sorting) are skipped.
+ * GDK merges these areas into a single expose.
+ */
+static void draw_positions(Collection *collection, int from, int to,
+			   const SortKey *keys)
+{
+	GtkWidget	*widget = GTK_WIDGET(collection);
+	int		first_row, last_row, row, col;
+
+	if (!GTK_WIDGET_REALIZED(widget))
+		return;
+
+	get_visible_limits(collection, &first_row, &last_row);
+
+	for (row = first_row; row <= last_row; row++)
+	{
+		for (col = 0; col < collection->columns; col++)
+		{
+			GdkRectangle area;
+			int	item;
+
+			item = collection_rowcol_to_item(collection, row, col);
+			if (item < from || item >= to)
+				continue;
+			if (keys && keys[item].index == item)
+				continue;
+
+			collection_get_item_area(collection, row, col, &area);
+			gdk_window_invalidate_rect(widget->window,
+						   &area, FALSE);
+		}
+	}
+}
+
+/* The size of this item, as last counted. Selections add these up, so
+ * they don't need to ask the item_size function each time.
+ */
+static double item_size(Collection *collection, int item)
+{
+	return collection->items[item].size;
+}
+
+/* Ask the item_size function how big this item is now */
+static double count_size(Collection *collection, int item)
+{
+	if (!collection->item_size)
+		return 0;
+	return collection->item_size(collection, &collection->items[item]);
+}
+
+/* Set (GDK_SET), unset (GDK_CLEAR) or toggle (GDK_INVERT) the selected
+ * state of items start to end - 1, updating number_selected and
+ * selected_size.
+ * Doesn't redraw anything or emit any signals.
+ * Returns TRUE if any item changed.
+ */
+static gboolean set_range_selected(Collection *collection,
+				   int start, int end, GdkFunction fn)
+{
+	CollectionItem	*items = collection->items;
+	int		i, selected = 0, changed = 0;
+	double		size = 0;
+
+	if (fn == GDK_INVERT)
+	{
+		for (i = start; i < end; i++)
+		{
+			items[i].selected = !items[i].selected;
+			if (items[i].selected)
+			{
+				selected++;
+				size += item_size(collection, i);
+			}
+			else
+				size -= item_size(collection, i);
+		}
+		changed = end - start;
+		collection->number_selected += 2 * selected - changed;
+		collection->selected_size += size;
+		return changed != 0;
+	}
+
+	for (i = start; i < end; i++)
+	{
+		if (items[i].selected == (fn == GDK_SET))
+			continue;
+		items[i].selected = fn == GDK_SET;
+		size += item_size(collection, i);
+		changed++;
+	}
+
+	if (fn == GDK_SET)
+	{
+		collection->number_selected += changed;
+		collection->selected_size += size;
+	}
+	else
+	{
+		collection->number_selected -= changed;
+		collection->selected_size -= size;
+	}
+
+	return changed != 0;
+}
+
+/* Emit gain_selection or lose_selection if the selection has become
+ * non-empty or empty since there were old_selected items, and
+ * selection_changed if 'changed'.
+ */
+static void emit_selection_signals(Collection *collection,
+				   guint old_selected, gboolean changed)
+{
+	if (collection->number_selected && !old_selected)
+		g_signal_emit(collection,
+				collection_signals[GAIN_SELECTION], 0,
+				current_event_time);
+	else if (!collection->number_selected && old_selected)
+		g_signal_emit(collection,
+				collection_signals[LOSE_SELECTION], 0,
+				current_event_time);
+
+	if (changed)
+		EMIT_SELECTION_CHANGED(collection, current_event_time);
+}
+
 static gint collection_expose(GtkWidget *widget, GdkEventExpose *event)
 {
 	Collection	*collection;
@@ -586,6 +724,13 @@ static gint collection_expose(GtkWidget *widget, GdkEventExpose *event)
 			if (item == 0 || item < collection->number_of_items) {
 				collection_get_item_area(collection,
 							 row, col, &item_area);
+				/* The area may be the bounding box of several
+				 * separate changes; skip items between them.
+				 */
+				if (gdk_region_rect_in(event->region,
+						&item_area) ==
+				    GDK_OVERLAP_RECTANGLE_OUT)
+					continue;
 		draw_one_item(collection, item, &item_area);
 		}
 	}
@@ -871,52 +1016,63 @@ static void collection_process_area(Collection	 *collection,
 				    GdkFunction  fn,
 				    guint32	 time)
 {
-	int		x, y;
 	int             rows = collection_get_rows(collection);
 	int             cols = collection->columns;
+	int		last_row, last_col, i;
+	int		first = collection->number_of_items, last = 0;
 	guint32		stacked_time;
-	int		item;
 	gboolean	changed = FALSE;
 	guint		old_selected;
 
 	g_return_if_fail(fn == GDK_SET || fn == GDK_INVERT);
 
+	last_row = MIN(area->y + area->height, rows) - 1;
+	last_col = MIN(area->x + area->width, cols) - 1;
+	if (last_row < area->y || last_col < area->x)
+		return;
+
 	old_selected = collection->number_selected;
 
 	stacked_time = current_event_time;
 	current_event_time = time;
 
-	collection->block_selection_changed++;
-
-	for (y = area->y; y < area->y + area->height && y < rows; y++)
-		for (x = area->x; x < area->x + area->width && x < cols; x++)
+	/* Each row (or column, in vertical order) of the area is a
+	 * range of items.
+	 */
+	for (i = collection->vertical_order ? area->x : area->y;
+	     i <= (collection->vertical_order ? last_col : last_row); i++)
 	{
-			item = collection_rowcol_to_item(collection, y, x);
-			if (item < collection->number_of_items) {
-			if (fn == GDK_INVERT)
-					collection_item_set_selected(
-					    collection, item, 
-					    !collection-> items[item].selected,
-					FALSE);
-			else
-					collection_item_set_selected(
-						collection, item, TRUE, FALSE);
+		int	start, end;
 
-			changed = TRUE;
+		if (collection->vertical_order)
+		{
+			start = collection_rowcol_to_item(collection,
+							  area->y, i);
+			end = collection_rowcol_to_item(collection,
+							last_row, i) + 1;
+		}
+		else
+		{
+			start = collection_rowcol_to_item(collection,
+							  i, area->x);
+			end = collection_rowcol_to_item(collection,
+							i, last_col) + 1;
 		}
+		end = MIN(end, collection->number_of_items);
+		if (start >= end)
+			continue;
+
+		if (set_range_selected(collection, start, end, fn))
+			changed = TRUE;
+		first = MIN(first, start);
+		last = MAX(last, end);
 	}
 
-	if (collection->number_selected && !old_selected)
-		g_signal_emit(collection,
-				collection_signals[GAIN_SELECTION], 0,
-				current_event_time);
-	else if (!collection->number_selected && old_selected)
-		g_signal_emit(collection,
-				collection_signals[LOSE_SELECTION], 0,
-				current_event_time);
-	
-	collection_unblock_selection_changed(collection,
-					current_event_time, changed);
+	if (changed)
+		draw_positions(collection, first, last, NULL);
+
+	emit_selection_signals(collection, old_selected, changed);
+
 	current_event_time = stacked_time;
 }
 
@@ -1144,6 +1300,7 @@ static void collection_item_set_selected(Collection *collection,
 	if (selected)
 	{
 		collection->number_selected++;
+		collection->selected_size += item_size(collection, item);
 		if (signal && collection->number_selected == 1)
 			g_signal_emit(collection,
 					collection_signals[GAIN_SELECTION], 0,
@@ -1152,6 +1309,7 @@ static void collection_item_set_selected(Collection *collection,
 	else
 	{
 		collection->number_selected--;
+		collection->selected_size -= item_size(collection, item);
 		if (signal && collection->number_selected == 0)
 			g_signal_emit(collection,
 					collection_signals[LOSE_SELECTION], 0,
@@ -1186,6 +1344,7 @@ gint collection_insert(Collection *collection, gpointer data, gpointer view)
 	collection->items[item].data = data;
 	collection->items[item].view_data = view;
 	collection->items[item].selected = FALSE;
+	collection->items[item].size = count_size(collection, item);
 
 	collection->number_of_items++;
 
@@ -1215,64 +1374,41 @@ void collection_toggle_item(Collection *collection, gint item)
 /* Select all items in the collection */
 void collection_select_all(Collection *collection)
 {
-	GtkWidget	*widget;
-	int		item = 0;
+	guint		old_selected;
 	
 	g_return_if_fail(collection != NULL);
 	g_return_if_fail(IS_COLLECTION(collection));
 
-	widget = GTK_WIDGET(collection);
-
 	if (collection->number_selected == collection->number_of_items)
 		return;		/* Nothing to do */
 
-	while (collection->number_selected < collection->number_of_items)
-	{
-		while (collection->items[item].selected)
-			item++;
+	old_selected = collection->number_selected;
 
-		collection->items[item].selected = TRUE;
-		collection_draw_item(collection, item, TRUE);
-		item++;
-		
-		collection->number_selected++;
-	}
+	set_range_selected(collection, 0, collection->number_of_items,
+			   GDK_SET);
+	draw_positions(collection, 0, collection->number_of_items, NULL);
 
-	g_signal_emit(collection, collection_signals[GAIN_SELECTION], 0,
-			current_event_time);
-	EMIT_SELECTION_CHANGED(collection, current_event_time);
+	emit_selection_signals(collection, old_selected, TRUE);
 }
 
 /* Toggle all items in the collection */
 void collection_invert_selection(Collection *collection)
 {
-	int		item;
+	guint		old_selected;
 	
 	g_return_if_fail(collection != NULL);
 	g_return_if_fail(IS_COLLECTION(collection));
 
-	if (collection->number_selected == 0)
-	{
-		collection_select_all(collection);
+	if (collection->number_of_items == 0)
 		return;
-	}
-	else if (collection->number_of_items == collection->number_selected)
-	{
-		collection_clear_selection(collection);
-		return;
-	}
 
-	for (item = 0; item < collection->number_of_items; item++)
-		collection->items[item].selected =
-			!collection->items[item].selected;
+	old_selected = collection->number_selected;
 
-	collection->number_selected = collection->number_of_items -
-				      collection->number_selected;
-	
-	/* Have to redraw everything... */
-	gtk_widget_queue_draw(GTK_WIDGET(collection));
-	
-	EMIT_SELECTION_CHANGED(collection, current_event_time);
+	set_range_selected(collection, 0, collection->number_of_items,
+			   GDK_INVERT);
+	draw_positions(collection, 0, collection->number_of_items, NULL);
+
+	emit_selection_signals(collection, old_selected, TRUE);
 }
 
 /* Unselect all items except number item, which is selected (-1 to unselect
@@ -1280,43 +1416,38 @@ void collection_invert_selection(Collection *collection)
  */
 void collection_clear_except(Collection *collection, gint item)
 {
-	GtkWidget	*widget;
-	int		i = 0;
-	int		end;		/* Selected items to end up with */
+	guint		old_selected;
+	gboolean	changed = FALSE;
 
 	g_return_if_fail(collection != NULL);
 	g_return_if_fail(IS_COLLECTION(collection));
 	g_return_if_fail(item >= -1 && item < collection->number_of_items);
-	
-	widget = GTK_WIDGET(collection);
 
-	if (item == -1)
-		end = 0;
-	else
+	old_selected = collection->number_selected;
+
+	if (item != -1 && !collection->items[item].selected)
 	{
-		collection_select_item(collection, item);
-		end = 1;
+		set_range_selected(collection, item, item + 1, GDK_SET);
+		collection_draw_item(collection, item, TRUE);
+		changed = TRUE;
 	}
 
-	if (collection->number_selected == 0)
-		return;
-
-	while (collection->number_selected > end)
+	if (collection->number_selected > (item == -1 ? 0 : 1))
 	{
-		while (i == item || !collection->items[i].selected)
-			i++;
+		int	n = collection->number_of_items;
 
-		collection->items[i].selected = FALSE;
-		collection_draw_item(collection, i, TRUE);
-		i++;
-		
-		collection->number_selected--;
+		if (item == -1)
+			set_range_selected(collection, 0, n, GDK_CLEAR);
+		else
+		{
+			set_range_selected(collection, 0, item, GDK_CLEAR);
+			set_range_selected(collection, item + 1, n, GDK_CLEAR);
+		}
+		draw_positions(collection, 0, n, NULL);
+		changed = TRUE;
 	}
 
-	if (end == 0)
-		g_signal_emit(collection, collection_signals[LOSE_SELECTION], 0,
-				current_event_time);
-	EMIT_SELECTION_CHANGED(collection, current_event_time);
+	emit_selection_signals(collection, old_selected, changed);
 }
 
 /* Unselect all items in the collection */
@@ -1383,104 +1514,277 @@ void collection_set_item_size(Collection *collection, int width, int height)
 	gtk_widget_queue_resize(GTK_WIDGET(collection));
 }
 
-static int (*cmp_callback)(const void *a, const void *b) = NULL;
-static int collection_cmp(const void *a, const void *b)
-{
-	return cmp_callback(((CollectionItem *) a)->data,
-			    ((CollectionItem *) b)->data);
-}
-static int collection_rcmp(const void *a, const void *b)
-{
-	return -cmp_callback(((CollectionItem *) a)->data,
-			     ((CollectionItem *) b)->data);
-}
-
 /* Cursor is positioned on item with the same data as before the sort.
  * Same for the wink item.
+ * get_keys may be NULL, but makes sorting large collections much faster.
+ * See sortkey.c.
  */
 void collection_qsort(Collection *collection,
 		      int (*compar)(const void *, const void *),
+		      SortKeyFunc get_keys,
 		      GtkSortType order)
 {
 	int	cursor, wink, items, wink_on_map;
-	gpointer cursor_data = NULL;
-	gpointer wink_data = NULL;
-	gpointer wink_on_map_data = NULL;
-	CollectionItem *array;
+	SortKey	*keys;
+	CollectionItem *old;
 	int	i;
-	int	mul = order == GTK_SORT_ASCENDING ? 1 : -1;
 	
 	g_return_if_fail(collection != NULL);
 	g_return_if_fail(IS_COLLECTION(collection));
 	g_return_if_fail(compar != NULL);
-	g_return_if_fail(cmp_callback == NULL);
 
-	/* Check to see if it needs sorting (saves redrawing) */
-	if (collection->number_of_items < 2)
+	items = collection->number_of_items;
+	if (items < 2)
 		return;
 
-	array = collection->items;
-	for (i = 1; i < collection->number_of_items; i++)
+	keys = g_new(SortKey, items);
+	for (i = 0; i < items; i++)
+		keys[i].data = collection->items[i].data;
+
+	if (!sortkey_sort(keys, items, compar, get_keys, order))
 	{
-		if (mul * compar(array[i - 1].data, array[i].data) > 0)
-			break;
+		g_free(keys);
+		return;		/* Already sorted (saves redrawing) */
 	}
-	if (i == collection->number_of_items)
-		return;		/* Already sorted */
 
-	items = collection->number_of_items;
+	old = g_new(CollectionItem, items);
+	memcpy(old, collection->items, items * sizeof(CollectionItem));
 
+	cursor = collection->cursor_item;
+	wink = collection->wink_item;
 	wink_on_map = collection->wink_on_map;
-	if (wink_on_map >= 0 && wink_on_map < items)
+	collection->wink_item = -1;
+	collection->wink_on_map = -1;
+
+	for (i = 0; i < items; i++)
+		collection->items[i] = old[keys[i].index];
+
+	for (i = 0; i < items; i++)
 	{
-		wink_on_map_data = collection->items[wink_on_map].data;
-		collection->wink_on_map = -1;
+		int	was = keys[i].index;
+
+		if (was == cursor)
+			collection_set_cursor_item(collection, i, TRUE);
+		if (was == wink_on_map)
+			collection->wink_on_map = i;
+		if (was == wink)
+		{
+			collection->cursor_item_old = i;
+			collection->wink_item = i;
+			scroll_to_show(collection, i);
+		}
 	}
-	else
-		wink = -1;
 
-	wink = collection->wink_item;
-	if (wink >= 0 && wink < items)
+	draw_positions(collection, 0, items, keys);
+
+	g_free(old);
+	g_free(keys);
+}
+
+/* The item indexes which must follow their data when items are moved about
+ * by collection_merge_new() and collection_extract_items().
+ */
+#define N_TRACKED 4
+static void get_tracked(Collection *collection, gint *tracked[N_TRACKED])
+{
+	tracked[0] = &collection->cursor_item;
+	tracked[1] = &collection->cursor_item_old;
+	tracked[2] = &collection->wink_item;
+	tracked[3] = &collection->wink_on_map;
+}
+
+/* Items from 'first' onwards have just been added and are in no particular
+ * order, while the items before them are already sorted. Sort only the new
+ * items and merge them in, so the number of comparisons depends on the size
+ * of the new batch rather than on the size of the whole collection.
+ * The cursor and wink items stay with their data, as for collection_qsort().
+ */
+void collection_merge_new(Collection *collection, int first,
+			  int (*compar)(const void *, const void *),
+			  SortKeyFunc get_keys,
+			  GtkSortType order)
+{
+	gint	*tracked[N_TRACKED];
+	gpointer tracked_data[N_TRACKED];	/* Tracked new items */
+	CollectionItem *array, *new;
+	SortKey	*keys;
+	int	mul = order == GTK_SORT_ASCENDING ? 1 : -1;
+	int	n_new, old_end, cursor, wink, k, t;
+
+	g_return_if_fail(collection != NULL);
+	g_return_if_fail(IS_COLLECTION(collection));
+	g_return_if_fail(compar != NULL);
+	g_return_if_fail(first >= 0 && first <= collection->number_of_items);
+
+	n_new = collection->number_of_items - first;
+	if (n_new == 0)
+		return;
+	if (first == 0)
 	{
-		wink_data = collection->items[wink].data;
-		collection->wink_item = -1;
+		collection_qsort(collection, compar, get_keys, order);
+		return;
 	}
-	else
-		wink = -1;
 
+	array = collection->items;
+
+	keys = g_new(SortKey, n_new);
+	for (k = 0; k < n_new; k++)
+		keys[k].data = array[first + k].data;
+	sortkey_sort(keys, n_new, compar, get_keys, order);
+
+	new = g_new(CollectionItem, n_new);
+	for (k = 0; k < n_new; k++)
+		new[k] = array[first + keys[k].index];
+	g_free(keys);
+
+	get_tracked(collection, tracked);
+	for (t = 0; t < N_TRACKED; t++)
+	{
+		int i = *tracked[t];
+
+		tracked_data[t] = NULL;
+		if (i >= first && i < collection->number_of_items)
+			tracked_data[t] = array[i].data;
+	}
 	cursor = collection->cursor_item;
-	if (cursor >= 0 && cursor < items)
-		cursor_data = collection->items[cursor].data;
-	else
-		cursor = -1;
-	
-	cmp_callback = compar;
-	qsort(collection->items, items, sizeof(collection->items[0]),
-			order == GTK_SORT_ASCENDING ? collection_cmp
-						    : collection_rcmp);
-	cmp_callback = NULL;
+	wink = collection->wink_item;
 
-	if (cursor > -1 || wink > -1 || wink_on_map > -1)
+	/* Work down from the end. Each new item goes after any old items
+	 * which compare equal to it, and the old items above it move up
+	 * past all the new items not yet placed.
+	 */
+	old_end = first;
+	for (k = n_new - 1; k >= 0; k--)
 	{
-		int	item;
+		int	lower = 0, upper = old_end;
 
-		for (item = 0; item < items; item++)
+		while (lower < upper)
 		{
-			if (collection->items[item].data == cursor_data)
-				collection_set_cursor_item(collection, item,
-						TRUE);
-			if (collection->items[item].data == wink_on_map_data)
-				collection->wink_on_map = item;
-			if (collection->items[item].data == wink_data)
+			int	i = (lower + upper) >> 1;
+
+			if (mul * compar(array[i].data, new[k].data) > 0)
+				upper = i;
+			else
+				lower = i + 1;
+		}
+
+		if (lower < old_end)
+		{
+			memmove(array + lower + k + 1, array + lower,
+				(old_end - lower) * sizeof(CollectionItem));
+
+			for (t = 0; t < N_TRACKED; t++)
 			{
-				collection->cursor_item_old = item;
-				collection->wink_item = item;
-				scroll_to_show(collection, item);
+				gint *i = tracked[t];
+
+				if (!tracked_data[t] &&
+				    *i >= lower && *i < old_end)
+					*i += k + 1;
 			}
 		}
+
+		array[lower + k] = new[k];
+		for (t = 0; t < N_TRACKED; t++)
+			if (tracked_data[t] && tracked_data[t] == new[k].data)
+				*tracked[t] = lower + k;
+
+		old_end = lower;
+		if (old_end == 0)
+		{
+			/* Everything else goes at the start, in order */
+			memcpy(array, new, k * sizeof(CollectionItem));
+			for (t = 0; t < N_TRACKED; t++)
+			{
+				int j;
+
+				for (j = 0; j < k; j++)
+					if (tracked_data[t] &&
+					    tracked_data[t] == new[j].data)
+						*tracked[t] = j;
+			}
+			break;
+		}
 	}
-	
-	gtk_widget_queue_draw(GTK_WIDGET(collection));
+
+	g_free(new);
+
+	if (collection->cursor_item != cursor && collection->cursor_item >= 0)
+		scroll_to_show(collection, collection->cursor_item);
+	else if (collection->wink_item != wink && collection->wink_item >= 0)
+		scroll_to_show(collection, collection->wink_item);
+
+	/* Everything below old_end is where it was (unless the items are
+	 * laid out in columns, in which case the new rows move everything).
+	 */
+	if (collection->vertical_order)
+		gtk_widget_queue_draw(GTK_WIDGET(collection));
+	else
+		draw_positions(collection, old_end,
+				collection->number_of_items, NULL);
+}
+
+/* Move every item for which 'test' returns TRUE to the end of the collection,
+ * keeping the order of the others. The cursor and wink items stay with their
+ * data. Returns the index of the first moved item (the number of items if
+ * none moved). Use this with collection_merge_new() to re-sort items whose
+ * data has changed.
+ */
+int collection_extract_items(Collection *collection,
+			     gboolean (*test)(gpointer data, gpointer user_data),
+			     gpointer user_data)
+{
+	gint	*tracked[N_TRACKED];
+	gint	new_pos[N_TRACKED];
+	gboolean was_moved[N_TRACKED];
+	GArray	*moved;
+	CollectionItem *array;
+	int	in, out = 0, t;
+
+	g_return_val_if_fail(collection != NULL, -1);
+	g_return_val_if_fail(IS_COLLECTION(collection), -1);
+	g_return_val_if_fail(test != NULL, -1);
+
+	get_tracked(collection, tracked);
+	for (t = 0; t < N_TRACKED; t++)
+	{
+		new_pos[t] = *tracked[t];
+		was_moved[t] = FALSE;
+	}
+
+	array = collection->items;
+	moved = g_array_new(FALSE, FALSE, sizeof(CollectionItem));
+
+	for (in = 0; in < collection->number_of_items; in++)
+	{
+		gboolean move = test(array[in].data, user_data);
+
+		for (t = 0; t < N_TRACKED; t++)
+		{
+			if (*tracked[t] != in)
+				continue;
+			new_pos[t] = move ? moved->len : out;
+			was_moved[t] = move;
+		}
+
+		if (move)
+			g_array_append_val(moved, array[in]);
+		else
+		{
+			if (in != out)
+				array[out] = array[in];
+			out++;
+		}
+	}
+
+	if (moved->len)
+		memcpy(array + out, moved->data,
+			moved->len * sizeof(CollectionItem));
+	g_array_free(moved, TRUE);
+
+	for (t = 0; t < N_TRACKED; t++)
+		*tracked[t] = was_moved[t] ? out + new_pos[t] : new_pos[t];
+
+	return out;
 }
 
 /* Find an item in a sorted collection.
@@ -1642,7 +1946,9 @@ void collection_delete_if(Collection *collection,
 {
 	int	in, out = 0;
 	int	selected = 0;
+	double	selected_size = 0;
 	int	cursor;
+	int	first_gone = -1;
 
 	g_return_if_fail(collection != NULL);
 	g_return_if_fail(IS_COLLECTION(collection));
@@ -1658,6 +1964,7 @@ void collection_delete_if(Collection *collection,
 			{
 				collection->items[out].selected = TRUE;
 				selected++;
+				selected_size += item_size(collection, in);
 			}
 			else
 				collection->items[out].selected = FALSE;
@@ -1666,11 +1973,15 @@ void collection_delete_if(Collection *collection,
 				collection->items[in].data;
 			collection->items[out].view_data =
 				collection->items[in].view_data;
+			collection->items[out].size =
+				collection->items[in].size;
 			out++;
 		}
 		else 
 		{
 			/* Remove item */
+			if (first_gone < 0)
+				first_gone = in;
 			if (collection->free_item)
 				collection->free_item(collection,
 							&collection->items[in]);
@@ -1700,11 +2011,15 @@ void collection_delete_if(Collection *collection,
 		}
 
 		collection->number_selected = selected;
+		collection->selected_size = selected_size;
 		resize_arrays(collection,
 			MAX(collection->number_of_items, MINIMUM_ITEMS));
 
-		if (GTK_WIDGET_REALIZED(GTK_WIDGET(collection)))
+		/* Items before the first deleted one haven't moved */
+		if (collection->vertical_order)
 			gtk_widget_queue_draw(GTK_WIDGET(collection));
+		else
+			draw_positions(collection, first_gone, in, NULL);
 
 		gtk_widget_queue_resize(GTK_WIDGET(collection));
 	}
@@ -1814,6 +2129,26 @@ void collection_end_lasso(Collection *collection, GdkFunction fn)
 	abort_lasso(collection);
 }
 
+/* Count this item's size again, adjusting selected_size if it's selected.
+ * Call this if the item's size may have changed.
+ */
+void collection_update_item_size(Collection *collection, int item)
+{
+	CollectionItem	*colitem;
+	double		size;
+
+	g_return_if_fail(collection != NULL);
+	g_return_if_fail(IS_COLLECTION(collection));
+	g_return_if_fail(item >= 0 && item < collection->number_of_items);
+
+	colitem = &collection->items[item];
+	size = count_size(collection, item);
+
+	if (colitem->selected)
+		collection->selected_size += size - colitem->size;
+	colitem->size = size;
+}
+
 /* Unblock the selection_changed signal, emitting the signal if the
  * block counter reaches zero and emit is TRUE.
  */
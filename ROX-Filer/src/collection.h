@@ -14,6 +14,8 @@
 #include <gdk/gdk.h>
 #include <gtk/gtkwidget.h>
 
+#include "sortkey.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -53,12 +55,15 @@ typedef gboolean (*CollectionTestFunc)( Collection *collection,
 					gpointer user_data);
 typedef void (*CollectionFreeFunc)(Collection *collection,
 			     	   CollectionItem *item);
+typedef double (*CollectionSizeFunc)(Collection *collection,
+				     CollectionItem *item);
 
 struct _CollectionItem
 {
 	gpointer	data;
 	gpointer	view_data;
 	gboolean	selected;
+	double		size;		/* item_size() when last counted */
 };
 
 struct _Collection
@@ -73,6 +78,7 @@ struct _Collection
 	CollectionDrawFunc draw_item;
 	CollectionTestFunc test_point;
 	CollectionFreeFunc free_item;
+	CollectionSizeFunc item_size;	/* NULL => all zero */
 	gpointer	cb_user_data;	/* Passed to above functions */
 
 	gboolean	lasso_box;	/* Is the box drawn? */
@@ -93,6 +99,7 @@ struct _Collection
 	guint		item_width, item_height;
 
 	guint		number_selected;
+	double		selected_size;	/* Sum of 'size' of selected items */
 
 	guint		array_size;
 
@@ -132,7 +139,18 @@ void 	collection_set_item_size	(Collection *collection,
 void 	collection_qsort		(Collection *collection,
 					 int (*compar)(const void *,
 						       const void *),
+					 SortKeyFunc get_keys,
+					 GtkSortType order);
+void 	collection_merge_new		(Collection *collection,
+					 int first,
+					 int (*compar)(const void *,
+						       const void *),
+					 SortKeyFunc get_keys,
 					 GtkSortType order);
+int	collection_extract_items	(Collection *collection,
+					 gboolean (*test)(gpointer data,
+							  gpointer user_data),
+					 gpointer user_data);
 int 	collection_find_item		(Collection *collection,
 					 gpointer data,
 					 int (*compar)(const void *,
@@ -153,6 +171,7 @@ void	collection_end_lasso		(Collection *collection,
 					 GdkFunction fn);
 void	collection_snap_size		(Collection *collection,
 					 int rows, int cols);
+void	collection_update_item_size	(Collection *collection, int item);
 void	collection_unblock_selection_changed(Collection *collection,
 					   guint time,
 					   gboolean emit);
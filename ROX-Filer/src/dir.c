@@ -28,6 +28,15 @@
  * and checked. Missing items are removed from the Directory, new items are
  * added and existing items are updated if they've changed.
  *
+ * Each call of the idle callback processes as many items as will fit in
+ * a short time budget (o_dir_recheck_budget), and then notifies the users
+ * of all the changes in that slice at once.
+ *
+ * If threads are available, the idle callback just hands the names to a
+ * pool of worker threads, which do the (possibly slow) system calls. The
+ * results are passed back to the main thread in batches and applied there,
+ * so the GUI doesn't freeze while a stat() blocks on a network filesystem.
+ *
  * When a whole directory is to be rescanned:
  * 
  * - A list of all filenames in the directory is fetched, without any
@@ -54,6 +63,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "global.h"
 
@@ -68,6 +78,8 @@
 #include "type.h"
 #include "usericons.h"
 #include "main.h"
+#include "options.h"
+#include "arena.h"
 
 #ifdef USE_NOTIFY
 static GHashTable *notify_fd_to_dir = NULL;
@@ -88,24 +100,63 @@ static int dnotify_last_fd = -1;
 /* For debugging. Can't detach when this is non-zero. */
 static int in_callback = 0;
 
+/* How long (ms) to spend on the recheck list per main loop iteration */
+static Option o_dir_recheck_budget;
+
+/* Limits for the number of items processed between checking the time */
+#define MIN_RECHECK_CHUNK 1
+#define MAX_RECHECK_CHUNK 1024
+
+static GTimer *slice_timer = NULL;
+static gint results_chunk = 16;	/* Adaptive chunk for stat_results_ready */
+
+/* Don't let the workers get too far ahead of the main thread. Results for
+ * items already handed out still have to be processed after a rescan.
+ */
+#define MAX_STATS_IN_FLIGHT 256
+#define MAX_STAT_THREADS 8
+
+/* A leaf to be statted by a worker thread. 'dir' holds a reference. */
+typedef struct _StatJob StatJob;
+
+struct _StatJob {
+	Directory	*dir;
+	guchar		*leafname;
+	guchar		*path;
+	DirItemStat	st;
+	int		stat_flags;	/* For diritem_stat() */
+};
+
+static GThreadPool *stat_pool = NULL;	/* NULL => no threads */
+static GAsyncQueue *stat_results = NULL;
+static gint stat_wakeup_pending = 0;	/* stat_results_ready queued */
+
 GFSCache *dir_cache = NULL;
 
 /* Static prototypes */
 static void update(Directory *dir, gchar *pathname, gpointer data);
 static void set_idle_callback(Directory *dir);
-static DirItem *insert_item(Directory *dir, const guchar *leafname);
+static DirItem *insert_item(Directory *dir, const guchar *leafname,
+			    DirItemStat *st);
 static void remove_missing(Directory *dir, GPtrArray *keep);
 static void dir_recheck(Directory *dir,
-			const guchar *path, const guchar *leafname);
+			const guchar *path, GPtrArray *leaves);
 static GPtrArray *hash_to_array(GHashTable *hash);
 static void dir_force_update_item(Directory *dir, const gchar *leaf);
 static Directory *dir_new(const char *pathname);
 static void dir_rescan(Directory *dir);
+static void update_stat_flags(Directory *dir);
+static void stat_worker(gpointer data, gpointer user_data);
+static gboolean stat_results_ready(gpointer data);
+static gboolean sniff_callback(gpointer data);
+static DirItem *sniff_item(Directory *dir, const gchar *leafname);
 #ifdef USE_NOTIFY
 static void dir_rescan_soon(Directory *dir);
 # ifdef USE_INOTIFY
 static gboolean inotify_handler(GIOChannel *source, GIOCondition condition,
 			    gpointer udata);
+static void leaf_changed(Directory *dir, const char *leaf);
+static void drop_changed_leaves(Directory *dir);
 # else
 static void dnotify_handler(int sig, siginfo_t *si, void *data);
 # endif
@@ -120,6 +171,23 @@ void dir_init(void)
 	dir_cache = g_fscache_new((GFSLoadFunc) dir_new,
 				(GFSUpdateFunc) update, NULL);
 
+	option_add_int(&o_dir_recheck_budget, "dir_recheck_budget", 8);
+	slice_timer = g_timer_new();
+
+	if (g_thread_supported())
+	{
+		long n_cpus;
+
+		/* Most of the time is spent waiting for the disk (or the
+		 * network), so use more threads than we have CPUs.
+		 */
+		n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		stat_results = g_async_queue_new();
+		stat_pool = g_thread_pool_new(stat_worker, NULL,
+				CLAMP(n_cpus * 2, 2, MAX_STAT_THREADS),
+				FALSE, NULL);
+	}
+
 #ifdef USE_NOTIFY
 	notify_fd_to_dir = g_hash_table_new(NULL, NULL);
 
@@ -152,14 +220,16 @@ void dir_init(void)
 }
 
 /* Periodically calls callback to notify about changes to the contents
- * of the directory.
+ * of the directory. 'stat_flags' says which optional details this user
+ * needs (see dir_set_stat_flags()).
  * Before this function returns, it calls the callback once to add all
  * the items currently in the directory (unless the dir is empty).
  * It then calls callback(DIR_QUEUE_INTERESTING) to find out which items the
  * caller cares about.
  * If we are not scanning, it also calls callback(DIR_END_SCAN).
  */
-void dir_attach(Directory *dir, DirCallback callback, gpointer data)
+void dir_attach(Directory *dir, DirCallback callback, gpointer data,
+		int stat_flags)
 {
 	DirUser	*user;
 	GPtrArray *items;
@@ -170,6 +240,12 @@ void dir_attach(Directory *dir, DirCallback callback, gpointer data)
 	user = g_new(DirUser, 1);
 	user->callback = callback;
 	user->data = data;
+	user->stat_flags = stat_flags;
+
+	/* The existing items were statted without these details */
+	if (stat_flags & ~dir->stat_flags)
+		dir->needs_update = TRUE;
+	dir->stat_flags |= stat_flags;
 
 #ifdef USE_INOTIFY
 	if (!dir->users)
@@ -182,7 +258,7 @@ void dir_attach(Directory *dir, DirCallback callback, gpointer data)
 		fd = inotify_add_watch( inotify_fd,
 					dir->pathname,
 					IN_CREATE | IN_DELETE | IN_MOVE |
-					IN_ATTRIB); 
+					IN_MODIFY | IN_ATTRIB);
 		
 		g_return_if_fail(g_hash_table_lookup(notify_fd_to_dir,
 						 GINT_TO_POINTER(fd)) == NULL);
@@ -256,6 +332,7 @@ void dir_detach(Directory *dir, DirCallback callback, gpointer data)
 		{
 			g_free(user);
 			dir->users = g_list_remove(dir->users, user);
+			update_stat_flags(dir);
 			g_object_unref(dir);
 
 			/* May stop scanning if noone's watching */
@@ -301,19 +378,35 @@ void refresh_dirs(const char *path)
  */
 void dir_check_this(const guchar *path)
 {
-	guchar	*real_path;
 	guchar	*dir_path;
-	Directory *dir;
+	GPtrArray *leaves;
 
 	dir_path = g_path_get_dirname(path);
-	real_path = pathdup(dir_path);
+	leaves = g_ptr_array_new();
+	g_ptr_array_add(leaves, (gpointer) g_basename(path));
+
+	dir_check_leaves(dir_path, leaves);
+
+	g_ptr_array_free(leaves, TRUE);
 	g_free(dir_path);
+}
+
+/* As dir_check_this(), for several items in the directory 'dir_path'.
+ * The directory is only looked up once, and its users are notified about
+ * all the changes together.
+ */
+void dir_check_leaves(const guchar *dir_path, GPtrArray *leaves)
+{
+	guchar	*real_path;
+	Directory *dir;
+
+	real_path = pathdup(dir_path);
 
 	dir = g_fscache_lookup_full(dir_cache, real_path,
 					FSCACHE_LOOKUP_PEEK, NULL);
 	if (dir)
 	{
-		dir_recheck(dir, real_path, g_basename(path));
+		dir_recheck(dir, real_path, leaves);
 		g_object_unref(dir);
 	}
 	
@@ -374,7 +467,22 @@ DirItem *dir_update_item(Directory *dir, const gchar *leafname)
 	DirItem *item;
 	
 	time(&diritem_recent_time);
-	item = insert_item(dir, leafname);
+	item = insert_item(dir, leafname, NULL);
+	dir_merge_new(dir);
+
+	return item;
+}
+
+/* As dir_update_item(), but check the contents too if the type was only
+ * guessed from the name. Use this when the real type is needed now (eg,
+ * to open the item); see dir_queue_sniff() otherwise.
+ */
+DirItem *dir_sniff_item(Directory *dir, const gchar *leafname)
+{
+	DirItem *item;
+
+	time(&diritem_recent_time);
+	item = sniff_item(dir, leafname);
 	dir_merge_new(dir);
 
 	return item;
@@ -395,6 +503,86 @@ void dir_queue_recheck(Directory *dir, DirItem *item)
 	item->flags &= ~ITEM_FLAG_NEED_RESCAN_QUEUE;
 }
 
+/* Items are normally typed from their names only (unless a user asks for
+ * DIRITEM_STAT_CONTENTS); those that might need their contents checking
+ * are marked ITEM_FLAG_NEED_SNIFF. Call this when such an item's real
+ * type is wanted (eg, because it's being displayed). It will be checked
+ * later in an idle callback, and users will get a DIR_UPDATE if it changes.
+ */
+void dir_queue_sniff(Directory *dir, DirItem *item)
+{
+	g_return_if_fail(dir != NULL);
+	g_return_if_fail(item != NULL);
+
+	if ((item->flags & (ITEM_FLAG_NEED_SNIFF | ITEM_FLAG_SNIFF_QUEUED))
+			!= ITEM_FLAG_NEED_SNIFF)
+		return;
+
+	item->flags |= ITEM_FLAG_SNIFF_QUEUED;
+	dir->sniff_list = g_list_prepend(dir->sniff_list,
+					 g_strdup(item->leafname));
+
+	if (!dir->sniff_callback)
+	{
+		g_object_ref(dir);
+		dir->sniff_callback = g_idle_add(sniff_callback, dir);
+	}
+}
+
+/* Tell the directory which optional details (DirItemStatFlags) this user
+ * displays. Items will only be guaranteed to have the details wanted by at
+ * least one user. If this user now wants more than before, the directory
+ * is rescanned to fill them in.
+ */
+void dir_set_stat_flags(Directory *dir, DirCallback callback, gpointer data,
+			int stat_flags)
+{
+	GList	*next;
+	int	old_flags = dir->stat_flags;
+
+	g_return_if_fail(dir != NULL);
+
+	for (next = dir->users; next; next = next->next)
+	{
+		DirUser *user = (DirUser *) next->data;
+
+		if (user->callback == callback && user->data == data)
+			user->stat_flags = stat_flags;
+	}
+
+	update_stat_flags(dir);
+
+	if ((dir->stat_flags & ~old_flags) == 0)
+		return;
+
+	if (dir->scanning)
+		dir->needs_update = TRUE;
+	else
+		dir_rescan(dir);
+}
+
+/* Recalculate dir->stat_flags from the users' flags */
+static void update_stat_flags(Directory *dir)
+{
+	GList	*next;
+
+	dir->stat_flags = 0;
+	for (next = dir->users; next; next = next->next)
+	{
+		DirUser *user = (DirUser *) next->data;
+
+		dir->stat_flags |= user->stat_flags;
+	}
+}
+
+/* The flags to pass to diritem_stat() for items in this directory */
+static int dir_stat_flags(Directory *dir)
+{
+	if (dir->remote)
+		return dir->stat_flags | DIRITEM_STAT_DONT_SYNC;
+	return dir->stat_flags;
+}
+
 static void free_recheck_list(Directory *dir)
 {
 	destroy_glist(&dir->recheck_list);
@@ -450,50 +638,224 @@ static void dir_error_changed(Directory *dir)
 	in_callback--;
 }
 
+/* Remove the first name from dir->recheck_list. g_free() the result. */
+static guchar *pop_recheck(Directory *dir)
+{
+	GList	*next;
+	guchar	*leaf;
+
+	next = dir->recheck_list;
+	dir->recheck_list = g_list_remove_link(dir->recheck_list, next);
+	leaf = (guchar *) next->data;
+	g_list_free_1(next);
+
+	return leaf;
+}
+
+/* Stop the idle callback (if any) */
+static void remove_idle_callback(Directory *dir)
+{
+	if (dir->idle_callback)
+	{
+		g_source_remove(dir->idle_callback);
+		dir->idle_callback = 0;
+	}
+}
+
+/* The recheck_list is empty and all the results are in. Stop scanning,
+ * unless needs_update, in which case we start scanning again.
+ */
+static void recheck_finished(Directory *dir)
+{
+	dir_merge_new(dir);
+	
+	dir->have_scanned = TRUE;
+	dir_set_scanning(dir, FALSE);
+	remove_idle_callback(dir);
+
+	if (dir->needs_update)
+		dir_rescan(dir);
+}
+
+/* The time budget for one slice of recheck work, in seconds */
+static gdouble recheck_budget(void)
+{
+	return CLAMP(o_dir_recheck_budget.int_value, 1, 1000) / 1000.0;
+}
+
+/* We processed 'done' items in 'elapsed' seconds, checking the time every
+ * '*chunk' items. Adjust *chunk so that we check about four times per
+ * 'budget', to avoid overrunning it by much without calling
+ * g_timer_elapsed() for every item.
+ */
+static void adapt_chunk(gint *chunk, guint done, gdouble elapsed,
+			gdouble budget)
+{
+	gdouble	ideal;
+
+	if (done == 0)
+		return;
+
+	if (elapsed <= 0)
+		ideal = MAX_RECHECK_CHUNK;
+	else
+		ideal = budget / 4 / (elapsed / done);
+
+	/* Smooth out the changes */
+	*chunk = CLAMP((*chunk + (gint) ideal) / 2,
+			MIN_RECHECK_CHUNK, MAX_RECHECK_CHUNK);
+}
+
+/* Hand 'leaf' to a worker thread to be statted. Takes ownership of
+ * 'leaf'. The result is applied later by stat_results_ready().
+ */
+static void queue_stat(Directory *dir, guchar *leaf)
+{
+	StatJob	*job;
+
+	job = g_new(StatJob, 1);
+	job->dir = dir;
+	job->leafname = leaf;
+	job->path = g_strdup(make_path(dir->pathname, leaf));
+	job->stat_flags = dir_stat_flags(dir);
+	g_object_ref(dir);
+
+	dir->stat_in_flight++;
+	g_thread_pool_push(stat_pool, job, NULL);
+}
+
 /* This is called in the background when there are items on the
  * dir->recheck_list to process.
  */
 static gboolean recheck_callback(gpointer data)
 {
 	Directory *dir = (Directory *) data;
-	GList	*next;
-	guchar	*leaf;
+	gdouble	budget, elapsed;
+	guint	done = 0;
 	
 	g_return_val_if_fail(dir != NULL, FALSE);
 	g_return_val_if_fail(dir->recheck_list != NULL, FALSE);
 
-	/* Remove the first name from the list */
-	next = dir->recheck_list;
-	dir->recheck_list = g_list_remove_link(dir->recheck_list, next);
-	leaf = (guchar *) next->data;
-	g_list_free_1(next);
+	if (stat_pool)
+	{
+		while (dir->recheck_list &&
+		       dir->stat_in_flight < MAX_STATS_IN_FLIGHT)
+			queue_stat(dir, pop_recheck(dir));
 
-	/* usleep(800); */
+		/* Either way, stat_results_ready() will call us again or
+		 * finish the scan once results come back.
+		 */
+		remove_idle_callback(dir);
+		return FALSE;
+	}
 
-	insert_item(dir, leaf);
+	budget = recheck_budget();
+	g_timer_start(slice_timer);
 
-	g_free(leaf);
+	do
+	{
+		gint	i;
+
+		for (i = 0; i < dir->recheck_chunk && dir->recheck_list; i++)
+		{
+			guchar	*leaf;
+
+			leaf = pop_recheck(dir);
+
+			/* usleep(800); */
+
+			insert_item(dir, leaf, NULL);
+
+			g_free(leaf);
+		}
+		done += i;
+
+		elapsed = g_timer_elapsed(slice_timer, NULL);
+	} while (dir->recheck_list && elapsed < budget);
+
+	adapt_chunk(&dir->recheck_chunk, done, elapsed, budget);
 
 	if (dir->recheck_list)
-		return TRUE;	/* Call again */
+	{
+		/* Show what we've got so far, and call again */
+		dir_merge_new(dir);
+		return TRUE;
+	}
 
-	/* The recheck_list list empty. Stop scanning, unless
-	 * needs_update, in which case we start scanning again.
-	 */
+	recheck_finished(dir);
+
+	return FALSE;
+}
+
+/* Idle callback to check the contents of the items on dir->sniff_list.
+ * Like recheck_callback(), this stops after the time budget and notifies
+ * users of the changes so far.
+ */
+static gboolean sniff_callback(gpointer data)
+{
+	Directory *dir = (Directory *) data;
+	gdouble	budget;
+
+	if (!dir->users)
+	{
+		GList	*next;
+
+		/* Let them be queued again if someone attaches later */
+		for (next = dir->sniff_list; next; next = next->next)
+		{
+			DirItem *item;
+
+			item = g_hash_table_lookup(dir->known_items,
+						   next->data);
+			if (item)
+				item->flags &= ~ITEM_FLAG_SNIFF_QUEUED;
+		}
+		destroy_glist(&dir->sniff_list);
+	}
+
+	time(&diritem_recent_time);
+	budget = recheck_budget();
+	g_timer_start(slice_timer);
+
+	while (dir->sniff_list)
+	{
+		GList	*next = dir->sniff_list;
+		guchar	*leaf = (guchar *) next->data;
+		DirItem	*item;
+
+		dir->sniff_list = g_list_remove_link(dir->sniff_list, next);
+		g_list_free_1(next);
+
+		item = g_hash_table_lookup(dir->known_items, leaf);
+		if (item && item->flags & ITEM_FLAG_NEED_SNIFF)
+			sniff_item(dir, leaf);
+		g_free(leaf);
+
+		if (g_timer_elapsed(slice_timer, NULL) >= budget)
+			break;
+	}
 
 	dir_merge_new(dir);
-	
-	dir->have_scanned = TRUE;
-	dir_set_scanning(dir, FALSE);
-	g_source_remove(dir->idle_callback);
-	dir->idle_callback = 0;
 
-	if (dir->needs_update)
-		dir_rescan(dir);
+	if (dir->sniff_list)
+		return TRUE;
+
+	dir->sniff_callback = 0;
+	g_object_unref(dir);
 
 	return FALSE;
 }
 
+/* Restat this item, checking its contents. Caller must merge the changes */
+static DirItem *sniff_item(Directory *dir, const gchar *leafname)
+{
+	DirItemStat st;
+
+	diritem_stat(make_path(dir->pathname, leafname), &st,
+		     dir_stat_flags(dir) | DIRITEM_STAT_CONTENTS);
+	return insert_item(dir, leafname, &st);
+}
+
 /* Add all the new items to the items array.
  * Notify everyone who is watching us.
  */
@@ -532,7 +894,7 @@ void dir_merge_new(Directory *dir)
 	{
 		DirItem	*item = (DirItem *) gone->pdata[i];
 
-		diritem_free(item);
+		diritem_free_in(dir->arena, item);
 	}
 	
 	g_ptr_array_set_size(gone, 0);
@@ -578,13 +940,93 @@ static gint rescan_soon_timeout(gpointer data)
  */
 static void dir_rescan_soon(Directory *dir)
 {
+#ifdef USE_INOTIFY
+	/* The rescan will pick up these changes too */
+	drop_changed_leaves(dir);
+#endif
 	if (dir->rescan_timeout != -1)
 		return;
 	dir->rescan_timeout = g_timeout_add(500, rescan_soon_timeout, dir);
 }
 #endif
 
-static void free_items_array(GPtrArray *array)
+#ifdef USE_INOTIFY
+/* How long to collect events for before acting on them (ms) */
+#define CHANGED_LEAVES_DELAY 200
+
+static void drop_changed_leaves(Directory *dir)
+{
+	if (dir->changed_timeout)
+	{
+		g_source_remove(dir->changed_timeout);
+		dir->changed_timeout = 0;
+	}
+	if (dir->changed_leaves)
+	{
+		g_hash_table_destroy(dir->changed_leaves);
+		dir->changed_leaves = NULL;
+	}
+}
+
+static void add_to_recheck_list(gpointer key, gpointer value, gpointer data)
+{
+	Directory *dir = (Directory *) data;
+
+	/* (takes ownership of the key) */
+	dir->recheck_list = g_list_prepend(dir->recheck_list, key);
+}
+
+/* Put the changed leaves on the recheck_list, so that they get restatted
+ * (and added or removed, as needed) in the usual way.
+ */
+static gboolean changed_leaves_timeout(gpointer data)
+{
+	Directory *dir = (Directory *) data;
+	GHashTable *leaves = dir->changed_leaves;
+
+	dir->changed_timeout = 0;
+	dir->changed_leaves = NULL;
+
+	g_hash_table_foreach(leaves, add_to_recheck_list, dir);
+	g_hash_table_destroy(leaves);
+
+	set_idle_callback(dir);
+
+	return FALSE;
+}
+
+/* 'leaf' in 'dir' has been created, deleted, changed or renamed. Events
+ * that arrive close together are collected, so that an item which is being
+ * written to constantly only gets restatted once in a while.
+ */
+static void leaf_changed(Directory *dir, const char *leaf)
+{
+	if (dir->rescan_timeout != -1)
+		return;		/* Whole directory will be rescanned anyway */
+
+	if (!dir->changed_leaves)
+		dir->changed_leaves = g_hash_table_new_full(g_str_hash,
+						g_str_equal, NULL, g_free);
+
+	if (!g_hash_table_lookup(dir->changed_leaves, leaf))
+	{
+		gchar *copy = g_strdup(leaf);
+
+		g_hash_table_insert(dir->changed_leaves, copy, copy);
+	}
+
+	if (!dir->changed_timeout)
+		dir->changed_timeout = g_timeout_add(CHANGED_LEAVES_DELAY,
+						changed_leaves_timeout, dir);
+}
+
+static void rescan_soon_cb(gpointer key, gpointer value, gpointer data)
+{
+	dir_rescan_soon((Directory *) value);
+}
+#endif
+
+static void free_items_array(Directory *dir, GPtrArray *array)
 {
 	guint	i;
 
@@ -592,7 +1034,7 @@ static void free_items_array(GPtrArray *array)
 	{
 		DirItem	*item = (DirItem *) array->pdata[i];
 
-		diritem_free(item);
+		diritem_free_in(dir->arena, item);
 	}
 
 	g_ptr_array_free(array, TRUE);
@@ -674,7 +1116,98 @@ static void remove_missing(Directory *dir, GPtrArray *keep)
 
 	notify_deleted(dir, deleted);
 
-	free_items_array(deleted);
+	free_items_array(dir, deleted);
+}
+
+/* Called in a worker thread. Stat the item and pass the job back to
+ * the main thread.
+ */
+static void stat_worker(gpointer data, gpointer user_data)
+{
+	StatJob	*job = (StatJob *) data;
+
+	diritem_stat(job->path, &job->st, job->stat_flags);
+
+	g_async_queue_push(stat_results, job);
+
+	if (g_atomic_int_compare_and_exchange(&stat_wakeup_pending, 0, 1))
+		g_idle_add(stat_results_ready, NULL);
+}
+
+/* Idle callback, in the main thread. Apply the results the workers
+ * have produced so far (as many as fit in the time budget), and notify
+ * users of each Directory once for the whole slice.
+ */
+static gboolean stat_results_ready(gpointer data)
+{
+	StatJob	*job = NULL;
+	GList	*dirs = NULL, *next;
+	gdouble	budget, elapsed;
+	guint	done = 0;
+	gboolean more;
+
+	g_atomic_int_compare_and_exchange(&stat_wakeup_pending, 1, 0);
+
+	time(&diritem_recent_time);
+
+	budget = recheck_budget();
+	g_timer_start(slice_timer);
+
+	do
+	{
+		gint	i;
+
+		for (i = 0; i < results_chunk; i++)
+		{
+			Directory *dir;
+
+			job = g_async_queue_try_pop(stat_results);
+			if (!job)
+				break;
+
+			dir = job->dir;
+			dir->stat_in_flight--;
+			insert_item(dir, job->leafname, &job->st);
+
+			/* Keep the job's reference until we've finished */
+			if (g_list_find(dirs, dir))
+				g_object_unref(dir);
+			else
+				dirs = g_list_prepend(dirs, dir);
+
+			g_free(job->leafname);
+			g_free(job->path);
+			g_free(job);
+		}
+		done += i;
+
+		elapsed = g_timer_elapsed(slice_timer, NULL);
+	} while (job && elapsed < budget);
+
+	adapt_chunk(&results_chunk, done, elapsed, budget);
+
+	/* If we ran out of time, make sure we get called again (unless a
+	 * worker has already arranged it).
+	 */
+	more = job && g_atomic_int_compare_and_exchange(&stat_wakeup_pending,
+							 0, 1);
+
+	for (next = dirs; next; next = next->next)
+	{
+		Directory *dir = (Directory *) next->data;
+
+		dir_merge_new(dir);
+
+		if (dir->recheck_list)
+			set_idle_callback(dir);		/* Queue some more */
+		else if (dir->stat_in_flight == 0 && dir->scanning)
+			recheck_finished(dir);
+
+		g_object_unref(dir);
+	}
+	g_list_free(dirs);
+
+	return more;
 }
 
 static gint notify_timeout(gpointer data)
@@ -703,15 +1236,20 @@ static void delayed_notify(Directory *dir)
 
 /* Stat this item and add, update or remove it.
  * Returns the new/updated item, if any.
+ * The changes are queued; call dir_merge_new() to notify users.
  * (leafname may be from the current DirItem item)
+ * If 'st' is non-NULL, it holds the results of a diritem_stat() already
+ * done for this item (by a worker thread), and no system calls are needed.
  * Ensure diritem_recent_time is reasonably up-to-date before calling this.
  */
-static DirItem *insert_item(Directory *dir, const guchar *leafname)
+static DirItem *insert_item(Directory *dir, const guchar *leafname,
+			    DirItemStat *st)
 {
 	const gchar  	*full_path;
 	DirItem		*item;
 	DirItem		old;
 	gboolean	do_compare = FALSE;	/* (old is filled in) */
+	DirItemStat	new_st;
 
 	if (leafname[0] == '.' && (leafname[1] == '\n' ||
 			(leafname[1] == '.' && leafname[2] == '\n')))
@@ -720,6 +1258,12 @@ static DirItem *insert_item(Directory *dir, const guchar *leafname)
 	full_path = make_path(dir->pathname, leafname);
 	item = g_hash_table_lookup(dir->known_items, leafname);
 
+	if (!st)
+	{
+		st = &new_st;
+		diritem_stat(full_path, st, dir_stat_flags(dir));
+	}
+
 	if (item)
 	{
 		if (item->base_type != TYPE_UNKNOWN)
@@ -730,7 +1274,7 @@ static DirItem *insert_item(Directory *dir, const guchar *leafname)
 				g_object_ref(old._image);
 			do_compare = TRUE;
 		}
-		diritem_restat(full_path, item, &dir->stat_info);
+		diritem_restat_from(full_path, item, &dir->stat_info, st);
 	}
 	else
 	{
@@ -738,12 +1282,12 @@ static DirItem *insert_item(Directory *dir, const guchar *leafname)
 		 * because blank items are added when scanning, before
 		 * we get here.
 		 */
-		item = diritem_new(leafname);
-		diritem_restat(full_path, item, &dir->stat_info);
+		item = diritem_new_in(dir->arena, leafname);
+		diritem_restat_from(full_path, item, &dir->stat_info, st);
 		if (item->base_type == TYPE_ERROR &&
 				item->lstat_errno == ENOENT)
 		{
-			diritem_free(item);
+			diritem_free_in(dir->arena, item);
 			return NULL;
 		}
 		g_ptr_array_add(dir->new_items, item);
@@ -762,7 +1306,6 @@ static DirItem *insert_item(Directory *dir, const guchar *leafname)
 		g_ptr_array_add(dir->gone_items, item);
 		if (do_compare && old._image)
 			g_object_unref(old._image);
-		delayed_notify(dir);
 		return NULL;
 	}
 
@@ -793,7 +1336,6 @@ static DirItem *insert_item(Directory *dir, const guchar *leafname)
 	}
 
 	g_ptr_array_add(dir->up_items, item);
-	delayed_notify(dir);
 
 	return item;
 }
@@ -814,12 +1356,14 @@ static void update(Directory *dir, gchar *pathname, gpointer data)
  */
 static void set_idle_callback(Directory *dir)
 {
-	if (dir->recheck_list && dir->users)
+	if ((dir->recheck_list || dir->stat_in_flight) && dir->users)
 	{
 		/* Work to do, and someone's watching */
 		dir_set_scanning(dir, TRUE);
-		if (dir->idle_callback)
+		if (dir->idle_callback || !dir->recheck_list)
 			return;
+		if (dir->stat_in_flight >= MAX_STATS_IN_FLIGHT)
+			return;		/* Wait for stat_results_ready() */
 		time(&diritem_recent_time);
 		dir->idle_callback = g_idle_add(recheck_callback, dir);
 		/* Do the first call now (will remove the callback itself) */
@@ -867,15 +1411,20 @@ out:
 }
 
 static void dir_recheck(Directory *dir,
-			const guchar *path, const guchar *leafname)
+			const guchar *path, GPtrArray *leaves)
 {
 	guchar *old = dir->pathname;
+	guint	i;
 
 	dir->pathname = g_strdup(path);
 	g_free(old);
 
 	time(&diritem_recent_time);
-	insert_item(dir, leafname);
+	for (i = 0; i < leaves->len; i++)
+		insert_item(dir, (guchar *) leaves->pdata[i], NULL);
+
+	if (dir->new_items->len || dir->up_items->len || dir->gone_items->len)
+		delayed_notify(dir);
 }
 
 static void to_array(gpointer key, gpointer value, gpointer data)
@@ -906,6 +1455,7 @@ static void dir_finialize(GObject *object)
 {
 	GPtrArray *items;
 	Directory *dir = (Directory *) object;
+	guint	i;
 
 	g_return_if_fail(dir->users == NULL);
 
@@ -915,6 +1465,9 @@ static void dir_finialize(GObject *object)
 	set_idle_callback(dir);
 	if (dir->rescan_timeout != -1)
 		g_source_remove(dir->rescan_timeout);
+#ifdef USE_INOTIFY
+	drop_changed_leaves(dir);
+#endif
 
 	dir_merge_new(dir);	/* Ensures new, up and gone are empty */
 
@@ -922,9 +1475,20 @@ static void dir_finialize(GObject *object)
 	g_ptr_array_free(dir->new_items, TRUE);
 	g_ptr_array_free(dir->gone_items, TRUE);
 
+	/* The items themselves are freed with the arena, but we still
+	 * need to drop their images.
+	 */
 	items = hash_to_array(dir->known_items);
-	free_items_array(items);
+	for (i = 0; i < items->len; i++)
+	{
+		DirItem	*item = (DirItem *) items->pdata[i];
+
+		if (item->_image)
+			g_object_unref(item->_image);
+	}
+	g_ptr_array_free(items, TRUE);
 	g_hash_table_destroy(dir->known_items);
+	arena_destroy(dir->arena);
 	
 	g_free(dir->error);
 	g_free(dir->pathname);
@@ -946,8 +1510,15 @@ static void directory_init(GTypeInstance *object, gpointer gclass)
 	Directory *dir = (Directory *) object;
 
 	dir->known_items = g_hash_table_new(g_str_hash, g_str_equal);
+	dir->arena = arena_new();
 	dir->recheck_list = NULL;
+	dir->stat_in_flight = 0;
+	dir->stat_flags = 0;
+	dir->remote = FALSE;
+	dir->recheck_chunk = MIN_RECHECK_CHUNK;
 	dir->idle_callback = 0;
+	dir->sniff_list = NULL;
+	dir->sniff_callback = 0;
 	dir->scanning = FALSE;
 	dir->have_scanned = FALSE;
 	
@@ -962,6 +1533,8 @@ static void directory_init(GTypeInstance *object, gpointer gclass)
 #endif
 #ifdef USE_INOTIFY
 	dir->inotify_source = 0;
+	dir->changed_leaves = NULL;
+	dir->changed_timeout = 0;
 #endif
 
 	dir->new_items = g_ptr_array_new();
@@ -1006,6 +1579,32 @@ static Directory *dir_new(const char *pathname)
 	return dir;
 }
 
+/* Convert the d_type field from readdir() to a base type.
+ * Returns TYPE_UNKNOWN if the filesystem didn't tell us, or for symlinks
+ * (we need to stat the target anyway).
+ */
+static int d_type_to_base_type(struct dirent *ent)
+{
+#ifdef DT_UNKNOWN
+	switch (ent->d_type)
+	{
+		case DT_REG:
+			return TYPE_FILE;
+		case DT_DIR:
+			return TYPE_DIRECTORY;
+		case DT_FIFO:
+			return TYPE_PIPE;
+		case DT_SOCK:
+			return TYPE_SOCKET;
+		case DT_CHR:
+			return TYPE_CHAR_DEVICE;
+		case DT_BLK:
+			return TYPE_BLOCK_DEVICE;
+	}
+#endif
+	return TYPE_UNKNOWN;
+}
+
 /* Get the names of all files in the directory.
  * Remove any DirItems that are no longer listed.
  * Replace the recheck_list with the items found.
@@ -1013,6 +1612,7 @@ static Directory *dir_new(const char *pathname)
 static void dir_rescan(Directory *dir)
 {
 	GPtrArray	*names;
+	GByteArray	*types;		/* Base type of each name, if known */
 	DIR		*d;
 	struct dirent	*ent;
 	guint		i;
@@ -1044,6 +1644,9 @@ static void dir_rescan(Directory *dir)
 		return;		/* Report on attach */
 	}
 
+	/* On network filesystems, we'll accept cached details */
+	dir->remote = mount_is_remote(pathname);
+
 	d = mc_opendir(pathname);
 	if (!d)
 	{
@@ -1058,8 +1661,11 @@ static void dir_rescan(Directory *dir)
 	gdk_flush();
 
 	/* Make a list of all the names in the directory */
+	types = g_byte_array_new();
 	while ((ent = mc_readdir(d)))
 	{
+		guint8	base_type;
+
 		if (ent->d_name[0] == '.')
 		{
 			if (ent->d_name[1] == '\0')
@@ -1068,7 +1674,10 @@ static void dir_rescan(Directory *dir)
 				continue;		/* Ignore '..' */
 		}
 
+		base_type = d_type_to_base_type(ent);
+
 		g_ptr_array_add(names, g_strdup(ent->d_name));
+		g_byte_array_append(types, &base_type, 1);
 	}
 	mc_closedir(d);
 
@@ -1082,6 +1691,8 @@ static void dir_rescan(Directory *dir)
 	/* For each name found, mark it as needing to be put on the rescan
 	 * list at some point in the future.
 	 * If the item is new, put a blank place-holder item in the directory.
+	 * If readdir() told us the type, the place-holder gets a suitable
+	 * icon straight away.
 	 */
 	for (i = 0; i < names->len; i++)
 	{
@@ -1100,7 +1711,8 @@ static void dir_rescan(Directory *dir)
 		{
 			DirItem *new;
 
-			new = diritem_new(name);
+			new = diritem_new_in(dir->arena, name);
+			diritem_set_provisional_type(new, types->data[i]);
 			g_ptr_array_add(dir->new_items, new);
 		}
 
@@ -1123,6 +1735,7 @@ static void dir_rescan(Directory *dir)
 	in_callback--;
 
 	g_ptr_array_free(names, TRUE);
+	g_byte_array_free(types, TRUE);
 		
 	set_idle_callback(dir);
 	dir_merge_new(dir);
@@ -1148,7 +1761,7 @@ static gboolean inotify_handler(GIOChannel *source, GIOCondition condition,
 {
 	int fd = g_io_channel_unix_get_fd(source);
 	Directory *dir;
-	char buf[sizeof(struct inotify_event)+1024];
+	char buf[64 * (sizeof(struct inotify_event) + 256)];
 	int len, i = 0;
 
 	len = read(fd, buf, sizeof(buf));
@@ -1165,12 +1778,28 @@ static gboolean inotify_handler(GIOChannel *source, GIOCondition condition,
 	{
 		struct inotify_event *event=(struct inotify_event *) (buf+i);
 
+		i += sizeof(*event)+event->len;
+
+		if (event->mask & IN_Q_OVERFLOW)
+		{
+			/* We've lost track of what changed */
+			g_hash_table_foreach(notify_fd_to_dir,
+					     rescan_soon_cb, NULL);
+			continue;
+		}
+
+		if (event->mask & IN_IGNORED)
+			continue;
+
 		dir = g_hash_table_lookup(notify_fd_to_dir,
 					  GINT_TO_POINTER(event->wd));
-		if (dir)
-			dir_rescan_soon(dir);
-    
-		i += sizeof(*event)+event->len;
+		if (!dir)
+			continue;
+
+		if (event->len && event->name[0])
+			leaf_changed(dir, event->name);
+		else
+			dir_rescan_soon(dir);	/* The directory itself */
 	}
 
 
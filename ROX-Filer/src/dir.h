@@ -46,6 +46,7 @@ struct _DirUser
 {
 	DirCallback	callback;
 	gpointer	data;
+	int		stat_flags;	/* DirItemStatFlags needed */
 };
 
 typedef struct _DirectoryClass DirectoryClass;
@@ -63,16 +64,24 @@ struct _Directory
 	char	*error;		/* NULL => no error */
 
 	struct stat	stat_info;	/* Internal use */
+	int		stat_flags;	/* Union of users' stat_flags */
+	gboolean	remote;		/* On a network filesystem */
 
 	gboolean	notify_active;	/* Notify timeout is running */
 	gint		idle_callback;	/* Idle callback ID */
 
 	GHashTable 	*known_items;	/* What our users know about */
+	Arena		*arena;		/* Storage for the DirItems */
 	GPtrArray	*new_items;	/* New items to add in */
 	GPtrArray	*up_items;	/* Items to redraw */
 	GPtrArray	*gone_items;	/* Items removed */
 
 	GList		*recheck_list;	/* Items to check on callback */
+	gint		stat_in_flight;	/* Items being statted by workers */
+	gint		recheck_chunk;	/* Items between time checks */
+
+	GList		*sniff_list;	/* Items to check the contents of */
+	gint		sniff_callback;	/* Idle callback ID (holds a ref) */
 
 	gboolean	have_scanned;	/* TRUE after first complete scan */
 	gboolean	scanning;	/* TRUE if we sent DIR_START_SCAN */
@@ -94,16 +103,21 @@ struct _Directory
 #endif
 #ifdef USE_INOTIFY
         guint           inotify_source;
+	GHashTable	*changed_leaves; /* Names with events pending */
+	guint		changed_timeout; /* See leaf_changed() */
 #endif
 };
 
 void dir_init(void);
-void dir_attach(Directory *dir, DirCallback callback, gpointer data);
+void dir_attach(Directory *dir, DirCallback callback, gpointer data,
+		int stat_flags);
 void dir_detach(Directory *dir, DirCallback callback, gpointer data);
 void dir_update(Directory *dir, gchar *pathname);
 void refresh_dirs(const char *path);
 void dir_check_this(const guchar *path);
+void dir_check_leaves(const guchar *dir_path, GPtrArray *leaves);
 DirItem *dir_update_item(Directory *dir, const gchar *leafname);
+DirItem *dir_sniff_item(Directory *dir, const gchar *leafname);
 void dir_merge_new(Directory *dir);
 void dir_force_update_path(const gchar *path);
 #if defined(USE_DNOTIFY)
@@ -111,5 +125,8 @@ void dnotify_wakeup(void);
 #endif
 void dir_drop_all_notifies(void);
 void dir_queue_recheck(Directory *dir, DirItem *item);
+void dir_queue_sniff(Directory *dir, DirItem *item);
+void dir_set_stat_flags(Directory *dir, DirCallback callback, gpointer data,
+			int stat_flags);
 
 #endif /* _DIR_H */
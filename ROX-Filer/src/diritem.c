@@ -31,6 +31,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#ifdef HAVE_STATX
+# include <fcntl.h>
+# include <sys/sysmacros.h>
+#endif
 
 #include "global.h"
 
@@ -44,6 +48,8 @@
 #include "fscache.h"
 #include "pixmaps.h"
 #include "xtypes.h"
+#include "arena.h"
+#include "typecache.h"
 
 #define RECENT_DELAY (5 * 60)	/* Time in seconds to consider a file recent */
 #define ABOUT_NOW(time) (diritem_recent_time - time < RECENT_DELAY)
@@ -52,9 +58,19 @@
  */
 time_t diritem_recent_time;
 
+#if defined(HAVE_STATX) && !defined(HAVE_LIBVFS)
+# define USE_STATX
+/* Set if the kernel turns out not to support statx() */
+static gboolean statx_missing = FALSE;
+#endif
+
 /* Static prototypes */
 static void examine_dir(const guchar *path, DirItem *item,
 			struct stat *link_target);
+static int stat_with_flags(const guchar *path, struct stat *info,
+			   int flags, gboolean follow);
+static MIME_type *find_type(const guchar *path, DirItem *item,
+			    struct stat *info, int flags);
 
 /****************************************************************
  *			EXTERNAL INTERFACE			*
@@ -69,6 +85,46 @@ void diritem_init(void)
  * 'parent' is optional; it saves one stat() for directories.
  */
 void diritem_restat(const guchar *path, DirItem *item, struct stat *parent)
+{
+	DirItemStat	st;
+
+	diritem_stat(path, &st, DIRITEM_STAT_ALL);
+	diritem_restat_from(path, item, parent, &st);
+}
+
+/* Do the system calls needed to restat 'path', without touching any
+ * shared state. This is safe to call from any thread; the results are
+ * applied with diritem_restat_from().
+ * 'flags' is a set of DirItemStatFlags saying which optional details are
+ * wanted. Others may be left as zero.
+ */
+void diritem_stat(const guchar *path, DirItemStat *st, int flags)
+{
+	st->flags = flags;
+	st->target_errno = 0;
+	st->has_xattr = FALSE;
+
+	if (stat_with_flags(path, &st->info, flags, FALSE) == -1)
+	{
+		st->lstat_errno = errno;
+		return;
+	}
+
+	st->lstat_errno = 0;
+
+	if (xattr_have(path))
+		st->has_xattr = TRUE;
+
+	if (S_ISLNK(st->info.st_mode) &&
+	    stat_with_flags(path, &st->target, flags, TRUE))
+		st->target_errno = errno;
+}
+
+/* As diritem_restat(), but using the results of an earlier call to
+ * diritem_stat() on 'path'.
+ */
+void diritem_restat_from(const guchar *path, DirItem *item,
+			 struct stat *parent, DirItemStat *st)
 {
 	struct stat	info;
 
@@ -80,9 +136,9 @@ void diritem_restat(const guchar *path, DirItem *item, struct stat *parent)
 	item->flags = 0;
 	item->mime_type = NULL;
 
-	if (mc_lstat(path, &info) == -1)
+	if (st->lstat_errno)
 	{
-		item->lstat_errno = errno;
+		item->lstat_errno = st->lstat_errno;
 		item->base_type = TYPE_ERROR;
 		item->size = 0;
 		item->mode = 0;
@@ -94,6 +150,8 @@ void diritem_restat(const guchar *path, DirItem *item, struct stat *parent)
 	{
 		guchar *target_path;
 
+		info = st->info;
+
 		item->lstat_errno = 0;
 		item->size = info.st_size;
 		item->mode = info.st_mode;
@@ -105,16 +163,19 @@ void diritem_restat(const guchar *path, DirItem *item, struct stat *parent)
 		if (ABOUT_NOW(item->mtime) || ABOUT_NOW(item->ctime))
 			item->flags |= ITEM_FLAG_RECENT;
 
-		if (xattr_have(path))
+		if (st->has_xattr)
 			item->flags |= ITEM_FLAG_HAS_XATTR;
 
 		if (S_ISLNK(info.st_mode))
 		{
-			if (mc_stat(path, &info))
+			if (st->target_errno)
 				item->base_type = TYPE_ERROR;
 			else
+			{
+				info = st->target;
 				item->base_type =
 					mode_to_base_type(info.st_mode);
+			}
 
 			item->flags |= ITEM_FLAG_SYMLINK;
 
@@ -155,17 +216,20 @@ void diritem_restat(const guchar *path, DirItem *item, struct stat *parent)
 	{
 		if (item->size == 0)
 			item->mime_type = text_plain;
+		else if (typecache_lookup(item, &info))
+			goto got_type;
 		else if (item->flags & ITEM_FLAG_SYMLINK)
 		{
 			guchar *link_path;
 			link_path = pathdup(path);
-			item->mime_type = type_from_path(link_path
+			item->mime_type = find_type(link_path
 					? link_path
-					: path);
+					: path, item, &info, st->flags);
 			g_free(link_path);
 		}
 		else
-			item->mime_type = type_from_path(path);
+			item->mime_type = find_type(path, item, &info,
+						    st->flags);
 	
 		/* Note: for symlinks we need the mode of the target */
 		if (info.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH))
@@ -192,6 +256,9 @@ void diritem_restat(const guchar *path, DirItem *item, struct stat *parent)
 			item->flags |= ITEM_FLAG_EXEC_FILE;
 		}
 
+		if (item->size != 0 && !(item->flags & ITEM_FLAG_NEED_SNIFF))
+			typecache_store(item, &info);
+got_type:
 		if (!item->mime_type)
 			item->mime_type = text_plain;
 
@@ -210,31 +277,74 @@ void diritem_restat(const guchar *path, DirItem *item, struct stat *parent)
 }
 
 DirItem *diritem_new(const guchar *leafname)
+{
+	return diritem_new_in(NULL, leafname);
+}
+
+/* As diritem_new(), but allocate the item, its leafname and its collate
+ * key from 'arena' (unless it's NULL). Free with diritem_free_in(), using
+ * the same arena.
+ */
+DirItem *diritem_new_in(Arena *arena, const guchar *leafname)
 {
 	DirItem		*item;
+	gsize		size;
 
-	item = g_new(DirItem, 1);
-	item->leafname = g_strdup(leafname);
+	/* The leafname is stored just after the DirItem */
+	size = sizeof(DirItem) + strlen(leafname) + 1;
+	item = arena ? arena_alloc(arena, size) : g_malloc(size);
+	item->leafname = (char *) (item + 1);
+	strcpy(item->leafname, leafname);
 	item->may_delete = FALSE;
 	item->_image = NULL;
 	item->base_type = TYPE_UNKNOWN;
 	item->flags = ITEM_FLAG_NEED_RESCAN_QUEUE;
 	item->mime_type = NULL;
-	item->leafname_collate = collate_key_new(leafname);
+	item->leafname_collate = collate_key_new_in(arena, leafname);
+	item->collate_prefix = collate_key_prefix(item->leafname_collate);
 
 	return item;
 }
 
 void diritem_free(DirItem *item)
+{
+	diritem_free_in(NULL, item);
+}
+
+/* Free an item created with diritem_new_in() */
+void diritem_free_in(Arena *arena, DirItem *item)
 {
 	g_return_if_fail(item != NULL);
 
 	if (item->_image)
 		g_object_unref(item->_image);
 	item->_image = NULL;
-	collate_key_free(item->leafname_collate);
-	g_free(item->leafname);
-	g_free(item);
+
+	if (arena)
+	{
+		arena_free(arena, item->leafname_collate);
+		arena_free(arena, item);
+	}
+	else
+	{
+		collate_key_free(item->leafname_collate);
+		g_free(item);
+	}
+}
+
+/* Called for a new item when we already know its base type from
+ * somewhere cheaper than stat() (eg, readdir's d_type). The item stays
+ * TYPE_UNKNOWN (it still needs to be restatted), but gets a generic
+ * mime_type, and hence an icon, to show in the meantime.
+ */
+void diritem_set_provisional_type(DirItem *item, int base_type)
+{
+	g_return_if_fail(item->base_type == TYPE_UNKNOWN);
+
+	if (base_type == TYPE_UNKNOWN || base_type == TYPE_ERROR)
+		return;
+
+	item->mime_type = mime_type_from_base_type(base_type);
 }
 
 /* For use by di_image() only. Sets item->_image. */
@@ -255,6 +365,87 @@ void _diritem_get_image(DirItem *item)
  *			INTERNAL FUNCTIONS			*
  ****************************************************************/
 
+#ifdef USE_STATX
+/* Copy the fields we use from a statx() result. Fields the kernel didn't
+ * return are left as zero.
+ */
+static void statx_to_stat(struct statx *stx, struct stat *info)
+{
+	memset(info, 0, sizeof(*info));
+
+	info->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	info->st_ino = stx->stx_ino;
+	info->st_mode = stx->stx_mode;
+	info->st_nlink = stx->stx_nlink;
+	info->st_uid = stx->stx_uid;
+	info->st_gid = stx->stx_gid;
+	info->st_size = stx->stx_size;
+
+	if (stx->stx_mask & STATX_ATIME)
+		info->st_atime = stx->stx_atime.tv_sec;
+	info->st_mtime = stx->stx_mtime.tv_sec;
+	info->st_ctime = stx->stx_ctime.tv_sec;
+}
+#endif
+
+/* Like stat() (or lstat(), if 'follow' is FALSE), but uses statx() if
+ * possible to fetch only the details in 'flags' (see diritem_stat()).
+ */
+static int stat_with_flags(const guchar *path, struct stat *info,
+			   int flags, gboolean follow)
+{
+#ifdef USE_STATX
+	struct statx	stx;
+	unsigned int	mask;
+	int		at_flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+
+	if (statx_missing)
+		goto fallback;
+
+	mask = STATX_TYPE | STATX_MODE | STATX_INO | STATX_NLINK |
+		STATX_UID | STATX_SIZE | STATX_MTIME | STATX_CTIME;
+	if (flags & DIRITEM_STAT_ATIME)
+		mask |= STATX_ATIME;
+	if (flags & DIRITEM_STAT_GROUP)
+		mask |= STATX_GID;
+	if (flags & DIRITEM_STAT_DONT_SYNC)
+		at_flags |= AT_STATX_DONT_SYNC;
+
+	if (statx(AT_FDCWD, path, at_flags, mask, &stx) == 0)
+	{
+		statx_to_stat(&stx, info);
+		return 0;
+	}
+
+	if (errno != ENOSYS)
+		return -1;
+
+	statx_missing = TRUE;	/* Old kernel; don't try again */
+fallback:
+#endif
+	return follow ? mc_stat(path, info) : mc_lstat(path, info);
+}
+
+/* Work out the type of the regular file 'path'. Unless 'flags' includes
+ * DIRITEM_STAT_CONTENTS, only the name is used, and the item is marked with
+ * ITEM_FLAG_NEED_SNIFF if its contents might say otherwise.
+ */
+static MIME_type *find_type(const guchar *path, DirItem *item,
+			    struct stat *info, int flags)
+{
+	MIME_type *type;
+	gboolean need_sniff;
+
+	if (flags & DIRITEM_STAT_CONTENTS)
+		return type_from_stat(path, info);
+
+	type = type_from_name(path, &need_sniff);
+	if (need_sniff)
+		item->flags |= ITEM_FLAG_NEED_SNIFF;
+
+	return type;
+}
+
 /* Fill in more details of the DirItem for a directory item.
  * - Looks for an image (but maybe still NULL on error)
  * - Updates ITEM_FLAG_APPDIR
@@ -8,6 +8,7 @@
 #define _DIRITEM_H
 
 #include <sys/types.h>
+#include <sys/stat.h>
 
 extern time_t diritem_recent_time;
 
@@ -28,12 +29,19 @@ typedef enum
 	ITEM_FLAG_NEED_RESCAN_QUEUE = 0x100,
 	
 	ITEM_FLAG_HAS_XATTR      = 0x200, /* Has extended attributes set */
+
+	/* The type was guessed from the name; the contents haven't been
+	 * checked yet. See dir_queue_sniff().
+	 */
+	ITEM_FLAG_NEED_SNIFF	= 0x400,
+	ITEM_FLAG_SNIFF_QUEUED	= 0x800, /* On the directory's sniff_list */
 } ItemFlags;
 
 struct _DirItem
 {
 	char		*leafname;
 	CollateKey	*leafname_collate; /* Preprocessed for sorting */
+	guint64		collate_prefix;	/* collate_key_prefix(leafname_collate) */
 	gboolean	may_delete;	/* Not yet found, this scan */
 	int		base_type;
 	int		flags;
@@ -47,15 +55,70 @@ struct _DirItem
 	int		lstat_errno;	/* 0 if details are valid */
 };
 
+/* Details which diritem_stat() only needs to fetch if someone will look at
+ * them (the type, mode, size, uid and times are needed for the filer's own
+ * use and are always fetched).
+ */
+typedef enum
+{
+	DIRITEM_STAT_ATIME	= 0x01,	/* Access time */
+	DIRITEM_STAT_GROUP	= 0x02,	/* Owning group */
+	DIRITEM_STAT_CONTENTS	= 0x04,	/* Read files to find their types */
+
+	/* Cached details are good enough; don't ask the server again.
+	 * Used on network filesystems.
+	 */
+	DIRITEM_STAT_DONT_SYNC	= 0x100,
+} DirItemStatFlags;
+
+#define DIRITEM_STAT_ALL (DIRITEM_STAT_ATIME | DIRITEM_STAT_GROUP | \
+			  DIRITEM_STAT_CONTENTS)
+
+/* The raw results of the system calls made when restatting an item.
+ * See diritem_stat().
+ */
+typedef struct _DirItemStat DirItemStat;
+
+struct _DirItemStat
+{
+	int		flags;		/* DirItemStatFlags wanted */
+	int		lstat_errno;	/* 0 if 'info' is valid */
+	struct stat	info;		/* From lstat() */
+	int		target_errno;	/* 0 if 'target' is valid (symlinks) */
+	struct stat	target;		/* From stat(), for symlinks only */
+	gboolean	has_xattr;
+};
+
 void diritem_init(void);
 DirItem *diritem_new(const guchar *leafname);
+DirItem *diritem_new_in(Arena *arena, const guchar *leafname);
 void diritem_restat(const guchar *path, DirItem *item, struct stat *parent);
+void diritem_stat(const guchar *path, DirItemStat *st, int flags);
+void diritem_restat_from(const guchar *path, DirItem *item,
+			 struct stat *parent, DirItemStat *st);
 void _diritem_get_image(DirItem *item);
 void diritem_free(DirItem *item);
+void diritem_free_in(Arena *arena, DirItem *item);
+void diritem_set_provisional_type(DirItem *item, int base_type);
 
+/* The size an item adds to the total for a selection. Directories (and
+ * items not yet scanned) don't count.
+ */
+static inline double di_total_size(DirItem *item)
+{
+	if (item->base_type == TYPE_DIRECTORY ||
+	    item->base_type == TYPE_UNKNOWN)
+		return 0;
+	return (double) item->size;
+}
+
+/* Items which haven't been scanned yet may still have a provisional
+ * mime_type (see diritem_set_provisional_type()).
+ */
 static inline MaskedPixmap *di_image(DirItem *item)
 {
-	if (!item->_image && item->base_type != TYPE_UNKNOWN)
+	if (!item->_image &&
+	    (item->base_type != TYPE_UNKNOWN || item->mime_type))
 		_diritem_get_image(item);
 	return item->_image;
 }
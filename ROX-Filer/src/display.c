@@ -56,9 +56,13 @@
 #include "fscache.h"
 #include "view_iface.h"
 #include "xtypes.h"
+#include "sortkey.h"
 
 #define HUGE_WRAP (1.5 * o_large_width.int_value)
 
+/* At most this many items have PangoLayouts at once (over all windows) */
+#define MAX_BUILT_VIEWS 2000
+
 /* Options bits */
 static Option o_display_caps_first;
 static Option o_display_dirs_first;
@@ -76,12 +80,113 @@ static Option o_filer_change_size_num;
 Option o_vertical_order_small, o_vertical_order_large;
 Option o_xattr_show;
 
+/* ViewDatas with layouts, most recently drawn first */
+static GQueue built_views = {NULL, NULL, 0};
+
+/* The measured size of some text. Names are mostly different, but the
+ * strings in the details column (permissions, owners, sizes, types) repeat
+ * a lot, so each is only laid out once per font.
+ */
+typedef struct _TextSize TextSize;
+struct _TextSize
+{
+	PangoFontDescription *font;	/* The window's font; see intern_font() */
+	int	wrap_width;		/* Pango units, or -1 */
+	int	flags;			/* TEXT_* attributes */
+	gchar	*text;
+	int	width, height;		/* Pixels; -1 if not measured yet */
+};
+
+enum {
+	TEXT_DETAILS		= 1 << 0,	/* Monospace details string */
+	TEXT_INVALID_UTF8	= 1 << 1,	/* Shown in red */
+	TEXT_BOLD		= 1 << 2,	/* Recently changed */
+};
+
+/* Details strings in the permissions column also record which set of
+ * permissions is underlined, in the bits above this.
+ */
+#define TEXT_UNDERLINE_SHIFT 3
+
+/* Forget everything after this many strings */
+#define MAX_TEXT_SIZES 50000
+
+static GHashTable *text_sizes = NULL;	/* TextSize -> TextSize */
+
+/* Each icon size has an atlas: a few large pixbufs holding the icons drawn
+ * recently, with any spotlight and emblems already composited on. Drawing
+ * an item is then a single copy from one of the pages.
+ */
+#define ATLAS_PAGE_SIZE 512	/* Width and height of each page */
+#define ATLAS_MAX_PAGES 8	/* Start again when they are all full */
+
+typedef struct _Atlas Atlas;
+typedef struct _AtlasIcon AtlasIcon;
+
+struct _Atlas
+{
+	GPtrArray	*pages;		/* GdkPixbufs */
+	GHashTable	*icons;		/* AtlasIcon -> AtlasIcon */
+	int		x, y;		/* Free space on the current shelf */
+	int		shelf_height;
+};
+
+struct _AtlasIcon
+{
+	Atlas		*atlas;
+	gboolean	gone;		/* The image has been finalized */
+
+	/* Key */
+	MaskedPixmap	*image;		/* Weak; entry is removed on finalize */
+	GtkStyle	*style;		/* (ref) Supplies the emblems */
+	int		flags;		/* ICON_* */
+	guint32		color;		/* Spotlight colour, if selected */
+	int		image_y;	/* Offset of the image in the area */
+
+	/* Where it is */
+	GdkPixbuf	*page;
+	int		src_x, src_y;
+	int		width, height;
+	int		top;		/* Offset of the page area in the area */
+};
+
+enum {
+	ICON_SELECTED	= 1 << 0,
+	ICON_MOUNT	= 1 << 1,
+	ICON_MOUNTED	= 1 << 2,
+	ICON_SYMLINK	= 1 << 3,
+	ICON_XATTR	= 1 << 4,
+};
+
+static Atlas huge_atlas, large_atlas, small_atlas;
+
 /* Static prototypes */
 static void display_details_set(FilerWindow *filer_window, DetailsType details);
 static void display_style_set(FilerWindow *filer_window, DisplayStyle style);
 static void options_changed(void);
 static char *details(FilerWindow *filer_window, DirItem *item);
+static void free_layouts(ViewData *view);
+static PangoLayout *scratch_layout(FilerWindow *filer_window,
+				   const char *key);
+static PangoFontDescription *intern_font(const PangoFontDescription *font);
+static TextSize *lookup_text_size(PangoFontDescription *font,
+				  int wrap_width, int flags,
+				  const char *text);
+static int name_wrap_width(FilerWindow *filer_window);
+static void set_name_layout(PangoLayout *layout,
+			    FilerWindow *filer_window,
+			    DirItem *item);
+static gboolean set_details_layout(PangoLayout *layout,
+				   FilerWindow *filer_window,
+				   DirItem *item);
 static void display_set_actual_size_real(FilerWindow *filer_window);
+static GdkPixbuf *emblem_pixbuf(GtkStyle *style, const char *stock_id);
+static void atlas_init(Atlas *atlas);
+static void draw_icon(Atlas *atlas, GdkWindow *window, GtkStyle *style,
+		      GdkRectangle *area, DirItem *item, MaskedPixmap *image,
+		      GdkPixbuf *pixbuf, int width, int height,
+		      int image_x, int image_y, int mount_y, int link_y,
+		      gboolean selected, GdkColor *color);
 
 /****************************************************************
  *			EXTERNAL INTERFACE			*
@@ -108,32 +213,19 @@ void display_init()
 	option_add_int(&o_xattr_show, "xattr_show", TRUE);
 
 	option_add_notify(options_changed);
+
+	atlas_init(&huge_atlas);
+	atlas_init(&large_atlas);
+	atlas_init(&small_atlas);
 }
 
 void draw_emblem_on_icon(GdkWindow *window, GtkStyle   *style,
 				const char *stock_id,
 				int *x, int y)
 {
-	GtkIconSet *icon_set;
 	GdkPixbuf  *pixbuf;
 
-	icon_set = gtk_style_lookup_icon_set(style,
-					     stock_id);
-	if (icon_set)
-	{
-		pixbuf = gtk_icon_set_render_icon(icon_set,
-						  style,
-						  GTK_TEXT_DIR_LTR,
-						  GTK_STATE_NORMAL,
-						  mount_icon_size,
-						  NULL,
-						  NULL);
-	}
-	else
-	{
-		pixbuf=im_unknown->pixbuf;
-		g_object_ref(pixbuf);
-	}
+	pixbuf = emblem_pixbuf(style, stock_id);
 	
 	gdk_pixbuf_render_to_drawable_alpha(pixbuf,
 				window,
@@ -157,7 +249,6 @@ void draw_huge_icon(GdkWindow *window, GtkStyle *style, GdkRectangle *area,
 	int		width, height;
 	int		image_x;
 	int		image_y;
-	GdkPixbuf	*pixbuf;
 
 	if (!image)
 		return;
@@ -167,39 +258,9 @@ void draw_huge_icon(GdkWindow *window, GtkStyle *style, GdkRectangle *area,
 	image_x = area->x + ((area->width - width) >> 1);
 	image_y = MAX(0, area->height - height - 6);
 
-	pixbuf = selected
-		? create_spotlight_pixbuf(image->huge_pixbuf, color)
-		: image->huge_pixbuf;
-
-	gdk_pixbuf_render_to_drawable_alpha(
-			pixbuf,
-			window,
-			0, 0, 				/* src */
-			image_x, area->y + image_y,	/* dest */
-			width, height,
-			GDK_PIXBUF_ALPHA_FULL, 128,	/* (unused) */
-			GDK_RGB_DITHER_NORMAL, 0, 0);
-
-	if (selected)
-		g_object_unref(pixbuf);
-
-	if (item->flags & ITEM_FLAG_MOUNT_POINT)
-	{
-		const char *mp = item->flags & ITEM_FLAG_MOUNTED
-					? ROX_STOCK_MOUNTED
-					: ROX_STOCK_MOUNT;
-		draw_emblem_on_icon(window, style, mp, &image_x, area->y + 2);
-	}
-	if (item->flags & ITEM_FLAG_SYMLINK)
-	{
-		draw_emblem_on_icon(window, style, ROX_STOCK_SYMLINK,
-				    &image_x, area->y + 2);
-	}
-	if ((item->flags & ITEM_FLAG_HAS_XATTR) && o_xattr_show.int_value)
-	{
-		draw_emblem_on_icon(window, style, ROX_STOCK_XATTR,
-				    &image_x, area->y + 2);
-	}
+	draw_icon(&huge_atlas, window, style, area, item,
+		  image, image->huge_pixbuf, width, height,
+		  image_x, image_y, 2, 2, selected, color);
 }
 
 /* Draw this icon (including any symlink or mount symbol) inside the
@@ -217,7 +278,6 @@ void draw_large_icon(GdkWindow *window,
 	int	height;
 	int	image_x;
 	int	image_y;
-	GdkPixbuf *pixbuf;
 
 	if (!image)
 		return;
@@ -227,39 +287,9 @@ void draw_large_icon(GdkWindow *window,
 	image_x = area->x + ((area->width - width) >> 1);
 	image_y = MAX(0, area->height - height - 6);
 
-	pixbuf = selected
-		? create_spotlight_pixbuf(image->pixbuf, color)
-		: image->pixbuf;
-
-	gdk_pixbuf_render_to_drawable_alpha(
-			pixbuf,
-			window,
-			0, 0, 				/* src */
-			image_x, area->y + image_y,	/* dest */
-			width, height,
-			GDK_PIXBUF_ALPHA_FULL, 128,	/* (unused) */
-			GDK_RGB_DITHER_NORMAL, 0, 0);
-
-	if (selected)
-		g_object_unref(pixbuf);
-
-	if (item->flags & ITEM_FLAG_MOUNT_POINT)
-	{
-		const char *mp = item->flags & ITEM_FLAG_MOUNTED
-					? ROX_STOCK_MOUNTED
-					: ROX_STOCK_MOUNT;
-		draw_emblem_on_icon(window, style, mp, &image_x, area->y + 2);
-	}
-	if (item->flags & ITEM_FLAG_SYMLINK)
-	{
-		draw_emblem_on_icon(window, style, ROX_STOCK_SYMLINK,
-				    &image_x, area->y + 2);
-	}
-	if ((item->flags & ITEM_FLAG_HAS_XATTR) && o_xattr_show.int_value)
-	{
-		draw_emblem_on_icon(window, style, ROX_STOCK_XATTR,
-				    &image_x, area->y + 2);
-	}
+	draw_icon(&large_atlas, window, style, area, item,
+		  image, image->pixbuf, width, height,
+		  image_x, image_y, 2, 2, selected, color);
 }
 
 void draw_small_icon(GdkWindow *window, GtkStyle *style, GdkRectangle *area,
@@ -267,7 +297,6 @@ void draw_small_icon(GdkWindow *window, GtkStyle *style, GdkRectangle *area,
 		     GdkColor *color)
 {
 	int		width, height, image_x, image_y;
-	GdkPixbuf	*pixbuf;
 	
 	if (!image)
 		return;
@@ -280,39 +309,9 @@ void draw_small_icon(GdkWindow *window, GtkStyle *style, GdkRectangle *area,
 	image_x = area->x + ((area->width - width) >> 1);
 	image_y = MAX(0, SMALL_HEIGHT - image->sm_height);
 		
-	pixbuf = selected
-		? create_spotlight_pixbuf(image->sm_pixbuf, color)
-		: image->sm_pixbuf;
-
-	gdk_pixbuf_render_to_drawable_alpha(
-			pixbuf,
-			window,
-			0, 0, 				/* src */
-			image_x, area->y + image_y,	/* dest */
-			width, height,
-			GDK_PIXBUF_ALPHA_FULL, 128,	/* (unused) */
-			GDK_RGB_DITHER_NORMAL, 0, 0);
-
-	if (selected)
-		g_object_unref(pixbuf);
-
-	if (item->flags & ITEM_FLAG_MOUNT_POINT)
-	{
-		const char *mp = item->flags & ITEM_FLAG_MOUNTED
-					? ROX_STOCK_MOUNTED
-					: ROX_STOCK_MOUNT;
-		draw_emblem_on_icon(window, style, mp, &image_x, area->y + 2);
-	}
-	if (item->flags & ITEM_FLAG_SYMLINK)
-	{
-		draw_emblem_on_icon(window, style, ROX_STOCK_SYMLINK,
-				    &image_x, area->y + 8);
-	}
-	if ((item->flags & ITEM_FLAG_HAS_XATTR) && o_xattr_show.int_value)
-	{
-		draw_emblem_on_icon(window, style, ROX_STOCK_XATTR,
-				    &image_x, area->y + 8);
-	}
+	draw_icon(&small_atlas, window, style, area, item,
+		  image, image->sm_pixbuf, width, height,
+		  image_x, image_y, 2, 8, selected, color);
 }
 
 /* The sort functions aren't called from outside, but they are
@@ -340,6 +339,13 @@ int sort_by_name(const void *item1, const void *item2)
 
 	SORT_DIRS;
 
+	/* Most names can be ordered by the start of their keys, without
+	 * even looking at the keys themselves.
+	 */
+	if (i1->collate_prefix != i2->collate_prefix &&
+	    !o_display_caps_first.int_value)
+		return i1->collate_prefix < i2->collate_prefix ? -1 : 1;
+
 	retval = collate_key_cmp(n1, n2, o_display_caps_first.int_value);
 
 	return retval ? retval : strcmp(i1->leafname, i2->leafname);
@@ -435,6 +441,197 @@ int sort_by_size(const void *item1, const void *item2)
 		sort_by_name(item1, item2);
 }
 
+/* Sort keys for the functions above; see sortkey.c.
+ *
+ * name_key() packs the SORT_DIRS and caps_first decisions and the start of
+ * the collation key into one number. The prefix loses its last two bits to
+ * make room, but this only means that more names compare equal here and
+ * have to be checked by sort_by_name().
+ */
+static guint64 name_key(const DirItem *item)
+{
+	guint64	flags = 0;
+
+	if (o_display_dirs_first.int_value && !IS_A_DIR(item))
+		flags |= 2;
+	if (o_display_caps_first.int_value &&
+	    !collate_key_caps(item->leafname_collate))
+		flags |= 1;
+
+	return (flags << 62) | (item->collate_prefix >> 2);
+}
+
+void sort_keys_by_name(SortKey *keys, int n)
+{
+	int	i;
+
+	for (i = 0; i < n; i++)
+		keys[i].key[0] = name_key((DirItem *) keys[i].data);
+}
+
+/* Order the types with mime_type_cmp() and use their positions as keys */
+static int mime_type_cmp(const void *a, const void *b)
+{
+	const MIME_type *m1 = *(MIME_type **) a;
+	const MIME_type *m2 = *(MIME_type **) b;
+	int	diff;
+
+	diff = strcmp(m1->media_type, m2->media_type);
+	if (!diff)
+		diff = strcmp(m1->subtype, m2->subtype);
+
+	return diff;
+}
+
+void sort_keys_by_type(SortKey *keys, int n)
+{
+	GHashTable *rank;
+	GPtrArray *types;
+	int	i;
+
+	rank = g_hash_table_new(NULL, NULL);
+	types = g_ptr_array_new();
+
+	for (i = 0; i < n; i++)
+	{
+		MIME_type *type = ((DirItem *) keys[i].data)->mime_type;
+
+		if (type && !g_hash_table_lookup(rank, type))
+		{
+			g_hash_table_insert(rank, type, type);
+			g_ptr_array_add(types, type);
+		}
+	}
+
+	qsort(types->pdata, types->len, sizeof(gpointer), mime_type_cmp);
+	for (i = 0; i < types->len; i++)
+		g_hash_table_insert(rank, types->pdata[i],
+				    GINT_TO_POINTER(i + 1));
+
+	for (i = 0; i < n; i++)
+	{
+		DirItem *item = (DirItem *) keys[i].data;
+
+		keys[i].key[0] = (guint64) item->base_type << 1 |
+				 (item->flags & ITEM_FLAG_APPDIR ? 1 : 0);
+		if (item->mime_type)
+			keys[i].key[1] = GPOINTER_TO_INT(
+				g_hash_table_lookup(rank, item->mime_type));
+		keys[i].key[2] = name_key(item);
+	}
+
+	g_ptr_array_free(types, TRUE);
+	g_hash_table_destroy(rank);
+}
+
+typedef struct _OwnerRank OwnerRank;
+
+struct _OwnerRank {
+	guint		id;
+	const gchar	*name;
+};
+
+static int owner_rank_cmp(const void *a, const void *b)
+{
+	return strcmp(((OwnerRank *) a)->name, ((OwnerRank *) b)->name);
+}
+
+/* Key on the position of each item's owner (or group) name among those of
+ * all the items. This also makes sure that the names are all in
+ * user_name()'s cache, so sort_by_owner() won't need to look any up.
+ */
+static void sort_keys_by_id(SortKey *keys, int n, gboolean group)
+{
+	GHashTable *rank;
+	GArray	*owners;
+	int	i, r;
+
+	rank = g_hash_table_new(NULL, NULL);
+	owners = g_array_new(FALSE, FALSE, sizeof(OwnerRank));
+
+	for (i = 0; i < n; i++)
+	{
+		DirItem *item = (DirItem *) keys[i].data;
+		OwnerRank owner;
+
+		owner.id = group ? item->gid : item->uid;
+		if (g_hash_table_lookup_extended(rank,
+				GUINT_TO_POINTER(owner.id), NULL, NULL))
+			continue;
+		owner.name = group ? group_name(item->gid)
+				   : user_name(item->uid);
+		g_hash_table_insert(rank, GUINT_TO_POINTER(owner.id), NULL);
+		g_array_append_val(owners, owner);
+	}
+
+	qsort(owners->data, owners->len, sizeof(OwnerRank), owner_rank_cmp);
+
+	/* Different IDs with the same name get the same rank */
+	for (i = 0, r = 0; i < owners->len; i++)
+	{
+		OwnerRank *owner = &g_array_index(owners, OwnerRank, i);
+
+		if (i > 0 && owner_rank_cmp(owner - 1, owner) != 0)
+			r++;
+		g_hash_table_insert(rank, GUINT_TO_POINTER(owner->id),
+				    GINT_TO_POINTER(r));
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		DirItem *item = (DirItem *) keys[i].data;
+		guint	id = group ? item->gid : item->uid;
+
+		keys[i].key[0] = GPOINTER_TO_INT(
+				g_hash_table_lookup(rank, GUINT_TO_POINTER(id)));
+		keys[i].key[1] = name_key(item);
+	}
+
+	g_array_free(owners, TRUE);
+	g_hash_table_destroy(rank);
+}
+
+void sort_keys_by_owner(SortKey *keys, int n)
+{
+	sort_keys_by_id(keys, n, FALSE);
+}
+
+void sort_keys_by_group(SortKey *keys, int n)
+{
+	sort_keys_by_id(keys, n, TRUE);
+}
+
+void sort_keys_by_date(SortKey *keys, int n)
+{
+	int	i;
+
+	for (i = 0; i < n; i++)
+	{
+		DirItem *item = (DirItem *) keys[i].data;
+
+		/* Flip the sign bit so that it sorts as unsigned */
+		keys[i].key[0] = (guint64) (gint64) item->mtime ^
+				 G_GUINT64_CONSTANT(0x8000000000000000);
+		keys[i].key[1] = name_key(item);
+	}
+}
+
+void sort_keys_by_size(SortKey *keys, int n)
+{
+	int	i;
+
+	for (i = 0; i < n; i++)
+	{
+		DirItem *item = (DirItem *) keys[i].data;
+		guint64 key = (guint64) item->size;
+
+		if (o_display_dirs_first.int_value && !IS_A_DIR(item))
+			key |= G_GUINT64_CONSTANT(0x8000000000000000);
+		keys[i].key[0] = key;
+		keys[i].key[1] = name_key(item);
+	}
+}
+
 void display_set_sort_type(FilerWindow *filer_window, SortType sort_type,
 			   GtkSortType order)
 {
@@ -445,6 +642,7 @@ void display_set_sort_type(FilerWindow *filer_window, SortType sort_type,
 	filer_window->sort_type = sort_type;
 	filer_window->sort_order = order;
 
+	filer_update_stat_flags(filer_window);
 	view_sort(filer_window->view);
 }
 
@@ -468,6 +666,7 @@ void display_set_layout(FilerWindow  *filer_window,
 	  
 	display_style_set(filer_window, style);
 	display_details_set(filer_window, details);
+	filer_update_stat_flags(filer_window);
 
 	/* Recreate layouts because wrapping may have changed */
 	view_style_changed(filer_window->view, VIEW_UPDATE_NAME);
@@ -597,6 +796,7 @@ ViewData *display_create_viewdata(FilerWindow *filer_window, DirItem *item)
 
 	view->layout = NULL;
 	view->details = NULL;
+	view->lru_link = NULL;
 	view->image = NULL;
 
 	display_update_view(filer_window, item, view, TRUE);
@@ -604,6 +804,154 @@ ViewData *display_create_viewdata(FilerWindow *filer_window, DirItem *item)
 	return view;
 }
 
+/* Each displayed item has a ViewData structure with some cached information
+ * to help quickly draw the item. This function updates this information.
+ * The sizes are always kept up-to-date, but the PangoLayouts themselves are
+ * only created when the item is drawn (see display_view_layouts()), so a big
+ * directory only costs layouts for the part of it which is on screen.
+ * Text sizes come from a cache shared by all windows (see lookup_text_size()).
+ * If update_name_layout is TRUE, the window's font may have changed.
+ */
+void display_update_view(FilerWindow *filer_window,
+			 DirItem *item,
+			 ViewData *view,
+			 gboolean update_name_layout)
+{
+	PangoLayout *layout;
+	PangoFontDescription *font;
+	TextSize *size;
+	int	w, h;
+	char	*str;
+
+	free_layouts(view);
+
+	font = intern_font(pango_context_get_font_description(
+			gtk_widget_get_pango_context(filer_window->window)));
+
+	if (update_name_layout && font != g_object_get_data(
+			G_OBJECT(filer_window->window), "rox-scratch-font"))
+	{
+		g_object_set_data(G_OBJECT(filer_window->window),
+				  "rox-scratch-font", font);
+		pango_layout_context_changed(scratch_layout(filer_window,
+						"rox-details-layout"));
+		pango_layout_context_changed(scratch_layout(filer_window,
+						"rox-name-layout"));
+	}
+
+	str = details(filer_window, item);
+	view->has_details = str != NULL;
+	if (str)
+	{
+		int flags = TEXT_DETAILS;
+
+		if (filer_window->details_type == DETAILS_PERMISSIONS)
+			flags |= (1 + applicable(item->uid, item->gid))
+					<< TEXT_UNDERLINE_SHIFT;
+
+		size = lookup_text_size(font, -1, flags, str);
+		if (size->width < 0)
+		{
+			layout = scratch_layout(filer_window,
+						"rox-details-layout");
+			set_details_layout(layout, filer_window, item);
+			pango_layout_get_size(layout, &w, &h);
+			size->width = w / PANGO_SCALE;
+			size->height = h / PANGO_SCALE;
+		}
+		g_free(str);
+
+		view->details_width = size->width;
+		view->details_height = size->height;
+	}
+	else
+		view->details_width = view->details_height = 0;
+
+	if (view->image)
+	{
+		g_object_unref(view->image);
+		view->image = NULL;
+	}
+
+	if (filer_window->show_thumbs && item->base_type == TYPE_FILE /*&&
+									strcmp(item->mime_type->media_type, "image") == 0*/)
+	{
+		const guchar    *path;
+
+		path = make_path(filer_window->real_path, item->leafname);
+
+		view->image = g_fscache_lookup_full(pixmap_cache, path,
+				FSCACHE_LOOKUP_ONLY_NEW, NULL);
+	}
+
+	if (!view->image)
+	{
+		view->image = di_image(item);
+		if (view->image)
+			g_object_ref(view->image);
+	}
+
+	size = lookup_text_size(font, name_wrap_width(filer_window),
+			(g_utf8_validate(item->leafname, -1, NULL)
+				? 0 : TEXT_INVALID_UTF8) |
+			(item->flags & ITEM_FLAG_RECENT ? TEXT_BOLD : 0),
+			item->leafname);
+	if (size->width < 0)
+	{
+		layout = scratch_layout(filer_window, "rox-name-layout");
+		set_name_layout(layout, filer_window, item);
+		pango_layout_get_size(layout, &w, &h);
+		size->width = w / PANGO_SCALE;
+		size->height = h / PANGO_SCALE;
+	}
+	view->name_width = size->width;
+	view->name_height = size->height;
+}
+
+/* Make sure view->layout (and view->details, if details are shown) exist,
+ * ready for drawing the item. Only the most recently drawn items keep their
+ * layouts; older ones are freed again.
+ */
+void display_view_layouts(FilerWindow *filer_window,
+			  DirItem *item,
+			  ViewData *view)
+{
+	if (view->lru_link)
+	{
+		/* Already built; just move it to the front */
+		g_queue_unlink(&built_views, view->lru_link);
+		g_queue_push_head_link(&built_views, view->lru_link);
+		return;
+	}
+
+	view->layout = gtk_widget_create_pango_layout(filer_window->window,
+						      NULL);
+	set_name_layout(view->layout, filer_window, item);
+
+	if (view->has_details)
+	{
+		view->details = gtk_widget_create_pango_layout(
+					filer_window->window, NULL);
+		set_details_layout(view->details, filer_window, item);
+	}
+
+	g_queue_push_head(&built_views, view);
+	view->lru_link = built_views.head;
+
+	if (built_views.length > MAX_BUILT_VIEWS)
+		free_layouts((ViewData *) g_queue_peek_tail(&built_views));
+}
+
+void display_free_viewdata(ViewData *view)
+{
+	free_layouts(view);
+
+	if (view->image)
+		g_object_unref(view->image);
+
+	g_free(view);
+}
+
 /* Set the display style to the desired style. If the desired style
  * is AUTO_SIZE_ICONS, choose an appropriate size. Also resizes filer
  * window, if requested.
@@ -732,104 +1080,138 @@ static void display_style_set(FilerWindow *filer_window, DisplayStyle style)
 	display_set_actual_size_real(filer_window);
 }
 
-/* Each displayed item has a ViewData structure with some cached information
- * to help quickly draw the item (eg, the PangoLayout). This function updates
- * this information.
+/* Drop the item's PangoLayouts, if it has any. They will be recreated
+ * if the item is drawn again.
  */
-void display_update_view(FilerWindow *filer_window,
-			 DirItem *item,
-			 ViewData *view,
-			 gboolean update_name_layout)
+static void free_layouts(ViewData *view)
 {
-	DisplayStyle	style = filer_window->display_style;
-	int	w, h;
-	int	wrap_width = -1;
-	char	*str;
-	static PangoFontDescription *monospace = NULL;
-	PangoAttrList *list = NULL;
+	if (!view->lru_link)
+		return;
 
-	if (!monospace)
-		monospace = pango_font_description_from_string("monospace");
-	
+	g_queue_delete_link(&built_views, view->lru_link);
+	view->lru_link = NULL;
+
+	g_object_unref(G_OBJECT(view->layout));
+	view->layout = NULL;
 	if (view->details)
 	{
 		g_object_unref(G_OBJECT(view->details));
 		view->details = NULL;
 	}
+}
 
-	str = details(filer_window, item);
-	if (str)
+/* A layout for measuring text in this window, without creating a new one
+ * for every item.
+ */
+static PangoLayout *scratch_layout(FilerWindow *filer_window,
+				   const char *key)
+{
+	GObject *window = G_OBJECT(filer_window->window);
+	PangoLayout *layout;
+
+	layout = g_object_get_data(window, key);
+	if (!layout)
 	{
-		PangoAttrList	*details_list;
-		int	perm_offset = -1;
-		
-		view->details = gtk_widget_create_pango_layout(
-					filer_window->window, str);
-		g_free(str);
+		layout = gtk_widget_create_pango_layout(filer_window->window,
+							NULL);
+		g_object_set_data_full(window, key, layout, g_object_unref);
+	}
 
-		pango_layout_set_font_description(view->details, monospace);
-		pango_layout_get_size(view->details, &w, &h);
-		view->details_width = w / PANGO_SCALE;
-		view->details_height = h / PANGO_SCALE;
+	return layout;
+}
 
-		if (filer_window->details_type == DETAILS_PERMISSIONS)
-			perm_offset = 0;
-		if (perm_offset > -1)
-		{
-			PangoAttribute	*attr;
+/* Returns a copy of 'font' which will last for ever. Equal fonts give the
+ * same pointer, so that text_size_equal() can compare them quickly.
+ */
+static PangoFontDescription *intern_font(const PangoFontDescription *font)
+{
+	static GList *fonts = NULL;
+	GList	*next;
 
-			attr = pango_attr_underline_new(PANGO_UNDERLINE_SINGLE);
+	for (next = fonts; next; next = next->next)
+	{
+		if (pango_font_description_equal(next->data, font))
+			return next->data;
+	}
 
-			perm_offset += 4 * applicable(item->uid, item->gid);
-			attr->start_index = perm_offset;
-			attr->end_index = perm_offset + 3;
+	fonts = g_list_prepend(fonts, pango_font_description_copy(font));
 
-			details_list = pango_attr_list_new();
-			pango_attr_list_insert(details_list, attr);
-			pango_layout_set_attributes(view->details,
-							details_list);
-		}
-	}
+	return fonts->data;
+}
 
-	if (view->image)
-	{
-		g_object_unref(view->image);
-		view->image = NULL;
-	}
+static guint text_size_hash(gconstpointer key)
+{
+	const TextSize *size = (TextSize *) key;
 
-	if (filer_window->show_thumbs && item->base_type == TYPE_FILE /*&&
-									strcmp(item->mime_type->media_type, "image") == 0*/)
-	{
-		const guchar    *path;
+	return g_str_hash(size->text) ^ GPOINTER_TO_UINT(size->font) ^
+		((guint) size->wrap_width << 8) ^ size->flags;
+}
 
-		path = make_path(filer_window->real_path, item->leafname);
+static gboolean text_size_equal(gconstpointer a, gconstpointer b)
+{
+	const TextSize *sa = (TextSize *) a;
+	const TextSize *sb = (TextSize *) b;
 
-		view->image = g_fscache_lookup_full(pixmap_cache, path,
-				FSCACHE_LOOKUP_ONLY_NEW, NULL);
-	}
+	return sa->font == sb->font && sa->wrap_width == sb->wrap_width &&
+	       sa->flags == sb->flags && strcmp(sa->text, sb->text) == 0;
+}
 
-	if (!view->image)
-	{
-		view->image = di_image(item);
-		if (view->image)
-			g_object_ref(view->image);
-	}
+static void text_size_free(gpointer data)
+{
+	TextSize *size = (TextSize *) data;
 
-	if (view->layout && update_name_layout)
+	g_free(size->text);
+	g_free(size);
+}
+
+/* Find the cached size of 'text' when shown in 'font' with these settings.
+ * If it hasn't been measured yet, the returned entry has a width of -1 and
+ * the caller must fill it in.
+ */
+static TextSize *lookup_text_size(PangoFontDescription *font,
+				  int wrap_width, int flags,
+				  const char *text)
+{
+	TextSize key, *size;
+
+	if (!text_sizes || g_hash_table_size(text_sizes) >= MAX_TEXT_SIZES)
 	{
-		g_object_unref(G_OBJECT(view->layout));
-		view->layout = NULL;
+		if (text_sizes)
+			g_hash_table_destroy(text_sizes);
+		text_sizes = g_hash_table_new_full(text_size_hash,
+						   text_size_equal,
+						   text_size_free, NULL);
 	}
 
-	if (view->layout)
+	key.font = font;
+	key.wrap_width = wrap_width;
+	key.flags = flags;
+	key.text = (gchar *) text;
+
+	size = g_hash_table_lookup(text_sizes, &key);
+	if (!size)
 	{
-		/* Do nothing */
+		size = g_new(TextSize, 1);
+		*size = key;
+		size->text = g_strdup(text);
+		size->width = size->height = -1;
+		g_hash_table_insert(text_sizes, size, size);
 	}
-	else if (g_utf8_validate(item->leafname, -1, NULL))
+
+	return size;
+}
+
+/* Set up 'layout' to show the item's name */
+static void set_name_layout(PangoLayout *layout,
+			    FilerWindow *filer_window,
+			    DirItem *item)
+{
+	PangoAttrList *list = NULL;
+
+	if (g_utf8_validate(item->leafname, -1, NULL))
 	{
-		view->layout = gtk_widget_create_pango_layout(
-				filer_window->window, item->leafname);
-		pango_layout_set_auto_dir(view->layout, FALSE);
+		pango_layout_set_text(layout, item->leafname, -1);
+		pango_layout_set_auto_dir(layout, FALSE);
 	}
 	else
 	{
@@ -837,8 +1219,7 @@ void display_update_view(FilerWindow *filer_window,
 		gchar *utf8;
 
 		utf8 = to_utf8(item->leafname);
-		view->layout = gtk_widget_create_pango_layout(
-				filer_window->window, utf8);
+		pango_layout_set_text(layout, utf8, -1);
 		g_free(utf8);
 
 		attr = pango_attr_foreground_new(0xffff, 0, 0);
@@ -861,26 +1242,75 @@ void display_update_view(FilerWindow *filer_window,
 		pango_attr_list_insert(list, attr);
 	}
 
+	pango_layout_set_attributes(layout, list);
 	if (list)
-		pango_layout_set_attributes(view->layout, list);
+		pango_attr_list_unref(list);
 
-	if (filer_window->details_type == DETAILS_NONE)
+#ifdef USE_PANGO_WRAP_WORD_CHAR
+	pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
+#endif
+	pango_layout_set_width(layout, name_wrap_width(filer_window));
+}
+
+/* The width at which names are wrapped, in Pango units, or -1 */
+static int name_wrap_width(FilerWindow *filer_window)
+{
+	DisplayStyle	style = filer_window->display_style;
+
+	if (filer_window->details_type != DETAILS_NONE)
+		return -1;
+
+	if (style == HUGE_ICONS)
+		return HUGE_WRAP * PANGO_SCALE;
+	else if (style == LARGE_ICONS)
+		return o_large_width.int_value * PANGO_SCALE;
+
+	return -1;
+}
+
+/* Set up 'layout' to show the item's details.
+ * Returns FALSE if details aren't being shown.
+ */
+static gboolean set_details_layout(PangoLayout *layout,
+				   FilerWindow *filer_window,
+				   DirItem *item)
+{
+	static PangoFontDescription *monospace = NULL;
+	PangoAttrList	*details_list = NULL;
+	char	*str;
+
+	if (!monospace)
+		monospace = pango_font_description_from_string("monospace");
+
+	str = details(filer_window, item);
+	if (!str)
+		return FALSE;
+
+	pango_layout_set_text(layout, str, -1);
+	g_free(str);
+
+	pango_layout_set_font_description(layout, monospace);
+
+	if (filer_window->details_type == DETAILS_PERMISSIONS)
 	{
-		if (style == HUGE_ICONS)
-			wrap_width = HUGE_WRAP * PANGO_SCALE;
-		else if (style == LARGE_ICONS)
-			wrap_width = o_large_width.int_value * PANGO_SCALE;
+		PangoAttribute	*attr;
+		int	perm_offset;
+
+		attr = pango_attr_underline_new(PANGO_UNDERLINE_SINGLE);
+
+		perm_offset = 4 * applicable(item->uid, item->gid);
+		attr->start_index = perm_offset;
+		attr->end_index = perm_offset + 3;
+
+		details_list = pango_attr_list_new();
+		pango_attr_list_insert(details_list, attr);
 	}
 
-#ifdef USE_PANGO_WRAP_WORD_CHAR
-	pango_layout_set_wrap(view->layout, PANGO_WRAP_WORD_CHAR);
-#endif
-	if (wrap_width != -1)
-		pango_layout_set_width(view->layout, wrap_width);
+	pango_layout_set_attributes(layout, details_list);
+	if (details_list)
+		pango_attr_list_unref(details_list);
 
-	pango_layout_get_size(view->layout, &w, &h);
-	view->name_width = w / PANGO_SCALE;
-	view->name_height = h / PANGO_SCALE;
+	return TRUE;
 }
 
 /* Sets display_style from display_style_wanted.
@@ -905,3 +1335,248 @@ static void display_set_actual_size_real(FilerWindow *filer_window)
 	
 	filer_window->display_style = size;
 }
+
+/* Returns a new ref to the pixbuf for this emblem */
+static GdkPixbuf *emblem_pixbuf(GtkStyle *style, const char *stock_id)
+{
+	GtkIconSet *icon_set;
+	GdkPixbuf  *pixbuf;
+
+	icon_set = gtk_style_lookup_icon_set(style,
+					     stock_id);
+	if (icon_set)
+	{
+		pixbuf = gtk_icon_set_render_icon(icon_set,
+						  style,
+						  GTK_TEXT_DIR_LTR,
+						  GTK_STATE_NORMAL,
+						  mount_icon_size,
+						  NULL,
+						  NULL);
+	}
+	else
+	{
+		pixbuf=im_unknown->pixbuf;
+		g_object_ref(pixbuf);
+	}
+
+	return pixbuf;
+}
+
+static guint atlas_icon_hash(gconstpointer key)
+{
+	const AtlasIcon *icon = (AtlasIcon *) key;
+
+	return GPOINTER_TO_UINT(icon->image) ^
+		(GPOINTER_TO_UINT(icon->style) >> 4) ^
+		icon->color ^ (icon->flags << 24) ^ (icon->image_y << 16);
+}
+
+static gboolean atlas_icon_equal(gconstpointer a, gconstpointer b)
+{
+	const AtlasIcon *ia = (AtlasIcon *) a;
+	const AtlasIcon *ib = (AtlasIcon *) b;
+
+	return ia->image == ib->image && ia->style == ib->style &&
+		ia->flags == ib->flags && ia->color == ib->color &&
+		ia->image_y == ib->image_y;
+}
+
+/* The image has been finalized, so nothing can draw this icon again.
+ * Its space in the page isn't reused until the atlas is reset.
+ */
+static void atlas_icon_gone(gpointer data, GObject *image)
+{
+	AtlasIcon *icon = (AtlasIcon *) data;
+
+	icon->gone = TRUE;
+	g_hash_table_remove(icon->atlas->icons, icon);
+}
+
+static void atlas_icon_free(gpointer data)
+{
+	AtlasIcon *icon = (AtlasIcon *) data;
+
+	if (!icon->gone)
+		g_object_weak_unref(G_OBJECT(icon->image),
+				    atlas_icon_gone, icon);
+	g_object_unref(icon->style);
+	g_free(icon);
+}
+
+static gboolean remove_all(gpointer key, gpointer value, gpointer data)
+{
+	return TRUE;
+}
+
+static void atlas_init(Atlas *atlas)
+{
+	atlas->pages = g_ptr_array_new();
+	atlas->icons = g_hash_table_new_full(atlas_icon_hash, atlas_icon_equal,
+					     NULL, atlas_icon_free);
+	atlas->x = atlas->y = atlas->shelf_height = 0;
+}
+
+/* Find space for a width x height icon, starting a new page if needed and
+ * discarding everything if all the pages are full. Sets icon's page and
+ * position.
+ */
+static void atlas_alloc(Atlas *atlas, AtlasIcon *icon)
+{
+	if (atlas->x + icon->width > ATLAS_PAGE_SIZE)
+	{
+		/* Start a new shelf */
+		atlas->x = 0;
+		atlas->y += atlas->shelf_height;
+		atlas->shelf_height = 0;
+	}
+
+	if (atlas->pages->len == 0 ||
+	    atlas->y + icon->height > ATLAS_PAGE_SIZE)
+	{
+		if (atlas->pages->len == ATLAS_MAX_PAGES)
+		{
+			int i;
+
+			g_hash_table_foreach_remove(atlas->icons,
+						    remove_all, NULL);
+			for (i = 0; i < atlas->pages->len; i++)
+				g_object_unref(atlas->pages->pdata[i]);
+			g_ptr_array_set_size(atlas->pages, 0);
+		}
+
+		g_ptr_array_add(atlas->pages,
+				gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8,
+					ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE));
+		atlas->x = atlas->y = atlas->shelf_height = 0;
+	}
+
+	icon->page = atlas->pages->pdata[atlas->pages->len - 1];
+	icon->src_x = atlas->x;
+	icon->src_y = atlas->y;
+
+	atlas->x += icon->width;
+	atlas->shelf_height = MAX(atlas->shelf_height, icon->height);
+}
+
+static void composite_at(GdkPixbuf *src, GdkPixbuf *dest, int x, int y,
+			 int width, int height)
+{
+	gdk_pixbuf_composite(src, dest, x, y, width, height,
+			     x, y, 1.0, 1.0, GDK_INTERP_NEAREST, 255);
+}
+
+/* Draw the width x height top-left corner of pixbuf (image's pixbuf at
+ * this size) at (image_x, area->y + image_y), with the item's emblems
+ * along the top, starting at image_x.
+ */
+static void draw_icon(Atlas *atlas, GdkWindow *window, GtkStyle *style,
+		      GdkRectangle *area, DirItem *item, MaskedPixmap *image,
+		      GdkPixbuf *pixbuf, int width, int height,
+		      int image_x, int image_y, int mount_y, int link_y,
+		      gboolean selected, GdkColor *color)
+{
+	AtlasIcon	key, *icon;
+
+	key.image = image;
+	key.style = style;
+	key.flags = 0;
+	key.color = 0;
+	key.image_y = image_y;
+
+	if (selected)
+	{
+		key.flags |= ICON_SELECTED;
+		key.color = ((color->red >> 8) << 16) |
+			    ((color->green >> 8) << 8) | (color->blue >> 8);
+	}
+	if (item->flags & ITEM_FLAG_MOUNT_POINT)
+		key.flags |= item->flags & ITEM_FLAG_MOUNTED ? ICON_MOUNTED
+							     : ICON_MOUNT;
+	if (item->flags & ITEM_FLAG_SYMLINK)
+		key.flags |= ICON_SYMLINK;
+	if ((item->flags & ITEM_FLAG_HAS_XATTR) && o_xattr_show.int_value)
+		key.flags |= ICON_XATTR;
+
+	icon = g_hash_table_lookup(atlas->icons, &key);
+	if (!icon)
+	{
+		GdkPixbuf	*emblem[3], *sub, *src;
+		int		emblem_y[3];
+		int		n_emblems = 0, i, x, bottom;
+
+		if (key.flags & (ICON_MOUNT | ICON_MOUNTED))
+		{
+			emblem_y[n_emblems] = mount_y;
+			emblem[n_emblems++] = emblem_pixbuf(style,
+				key.flags & ICON_MOUNTED ? ROX_STOCK_MOUNTED
+							 : ROX_STOCK_MOUNT);
+		}
+		if (key.flags & ICON_SYMLINK)
+		{
+			emblem_y[n_emblems] = link_y;
+			emblem[n_emblems++] = emblem_pixbuf(style,
+						ROX_STOCK_SYMLINK);
+		}
+		if (key.flags & ICON_XATTR)
+		{
+			emblem_y[n_emblems] = link_y;
+			emblem[n_emblems++] = emblem_pixbuf(style,
+						ROX_STOCK_XATTR);
+		}
+
+		icon = g_new(AtlasIcon, 1);
+		*icon = key;
+		icon->atlas = atlas;
+		icon->gone = FALSE;
+		g_object_ref(style);
+
+		/* The area covering the image and all the emblems */
+		icon->width = width;
+		icon->top = image_y;
+		bottom = image_y + height;
+		x = 0;
+		for (i = 0; i < n_emblems; i++)
+		{
+			x += gdk_pixbuf_get_width(emblem[i]) + 1;
+			icon->top = MIN(icon->top, emblem_y[i]);
+			bottom = MAX(bottom, emblem_y[i] +
+					gdk_pixbuf_get_height(emblem[i]));
+		}
+		icon->width = MAX(icon->width, x);
+		icon->height = bottom - icon->top;
+
+		atlas_alloc(atlas, icon);
+		sub = gdk_pixbuf_new_subpixbuf(icon->page,
+				icon->src_x, icon->src_y,
+				icon->width, icon->height);
+		gdk_pixbuf_fill(sub, 0);
+
+		src = selected ? create_spotlight_pixbuf(pixbuf, color)
+			       : pixbuf;
+		composite_at(src, sub, 0, image_y - icon->top, width, height);
+		if (selected)
+			g_object_unref(src);
+
+		x = 0;
+		for (i = 0; i < n_emblems; i++)
+		{
+			int w = gdk_pixbuf_get_width(emblem[i]);
+
+			composite_at(emblem[i], sub, x, emblem_y[i] - icon->top,
+				     w, gdk_pixbuf_get_height(emblem[i]));
+			x += w + 1;
+			g_object_unref(emblem[i]);
+		}
+		g_object_unref(sub);
+
+		g_object_weak_ref(G_OBJECT(image), atlas_icon_gone, icon);
+		g_hash_table_insert(atlas->icons, icon, icon);
+	}
+
+	gdk_draw_pixbuf(window, NULL, icon->page,
+			icon->src_x, icon->src_y,
+			image_x, area->y + icon->top,
+			icon->width, icon->height,
+			GDK_RGB_DITHER_NORMAL, 0, 0);
+}
@@ -16,9 +16,14 @@ typedef struct _ViewData ViewData;
 
 struct _ViewData
 {
+	/* Only created while the item is being drawn; see
+	 * display_view_layouts().
+	 */
 	PangoLayout *layout;
 	PangoLayout *details;
+	GList	*lru_link;	/* Non-NULL iff the layouts exist */
 
+	gboolean has_details;
 	int	name_width;
 	int	name_height;
 	int	details_width;
@@ -52,6 +57,12 @@ int sort_by_date(const void *item1, const void *item2);
 int sort_by_size(const void *item1, const void *item2);
 int sort_by_owner(const void *item1, const void *item2);
 int sort_by_group(const void *item1, const void *item2);
+void sort_keys_by_name(SortKey *keys, int n);
+void sort_keys_by_type(SortKey *keys, int n);
+void sort_keys_by_date(SortKey *keys, int n);
+void sort_keys_by_size(SortKey *keys, int n);
+void sort_keys_by_owner(SortKey *keys, int n);
+void sort_keys_by_group(SortKey *keys, int n);
 void display_set_sort_type(FilerWindow *filer_window, SortType sort_type,
 			   GtkSortType order);
 void display_set_autoselect(FilerWindow *filer_window, const gchar *leaf);
@@ -71,6 +82,10 @@ void display_update_view(FilerWindow *filer_window,
 			 DirItem *item,
 			 ViewData *view,
 			 gboolean update_name_layout);
+void display_view_layouts(FilerWindow *filer_window,
+			  DirItem *item,
+			  ViewData *view);
+void display_free_viewdata(ViewData *view);
 void display_update_views(FilerWindow *filer_window);
 void draw_small_icon(GdkWindow *window, GtkStyle *style, GdkRectangle *area,
 		     DirItem  *item, MaskedPixmap *image, gboolean selected,
@@ -28,7 +28,6 @@
 #include <ctype.h>
 #include <netdb.h>
 #include <sys/param.h>
-#include <fnmatch.h>
 
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>
@@ -64,6 +63,7 @@
 #include "action.h"
 #include "bookmarks.h"
 #include "xtypes.h"
+#include "pattern.h"
 
 static XMLwrapper *groups = NULL;
 
@@ -124,6 +124,7 @@ static GHashTable *unmount_prompt_actions = NULL;
 
 /* Static prototypes */
 static void attach(FilerWindow *filer_window);
+static int stat_flags(FilerWindow *filer_window);
 static void detach(FilerWindow *filer_window);
 static void filer_window_destroyed(GtkWidget    *widget,
 				   FilerWindow	*filer_window);
@@ -393,11 +394,13 @@ static void update_display(Directory *dir,
 	{
 		case DIR_ADD:
 			view_add_items(view, items);
+			minibuffer_index_add(filer_window, items);
 			/* Open and resize if currently hidden */
 			open_filer_window(filer_window);
 			break;
 		case DIR_REMOVE:
 			view_delete_if(view, if_deleted, items);
+			minibuffer_index_remove(filer_window, items);
 			toolbar_update_info(filer_window);
 			break;
 		case DIR_START_SCAN:
@@ -449,9 +452,10 @@ static void attach(FilerWindow *filer_window)
 {
 	gdk_window_set_cursor(filer_window->window->window, busy_cursor);
 	view_clear(filer_window->view);
+	minibuffer_index_clear(filer_window);
 	filer_window->scanning = TRUE;
 	dir_attach(filer_window->directory, (DirCallback) update_display,
-			filer_window);
+			filer_window, stat_flags(filer_window));
 	filer_set_title(filer_window);
 	bookmarks_add_history(filer_window->sym_path);
 
@@ -715,8 +719,9 @@ static void filer_window_destroyed(GtkWidget *widget, FilerWindow *filer_window)
 
 	if(filer_window->filter_string)
 		g_free(filer_window->filter_string);
-	if(filer_window->regexp)
-		g_free(filer_window->regexp);
+	if(filer_window->filter_pattern)
+		pattern_free(filer_window->filter_pattern);
+	minibuffer_index_clear(filer_window);
 
 	g_free(filer_window->auto_select);
 	g_free(filer_window->real_path);
@@ -885,6 +890,8 @@ void filer_openitem(FilerWindow *filer_window, ViewIter *iter, OpenFlags flags)
 
 	if (item->base_type == TYPE_UNKNOWN)
 		dir_update_item(filer_window->directory, item->leafname);
+	if (item->flags & ITEM_FLAG_NEED_SNIFF)
+		dir_sniff_item(filer_window->directory, item->leafname);
 
 	if (item->base_type == TYPE_DIRECTORY)
 	{
@@ -1510,8 +1517,11 @@ FilerWindow *filer_opendir(const char *path, FilerWindow *src_win,
 
 	filer_window->filter = FILER_SHOW_ALL;
 	filer_window->filter_string = NULL;
-	filer_window->regexp = NULL;
+	filer_window->filter_pattern = NULL;
 	filer_window->filter_directories = FALSE;
+
+	filer_window->mini_index = NULL;
+	filer_window->mini_index_sorted = FALSE;
 	
 	if (src_win && o_display_inherit_options.int_value)
 	{
@@ -1936,6 +1946,41 @@ static FilerWindow *find_filer_window(const char *sym_path, FilerWindow *diff)
 	return NULL;
 }
 
+/* Tell the directory which optional details this window displays, given
+ * its current view type, details and sort type. Call this when any of
+ * those change.
+ */
+void filer_update_stat_flags(FilerWindow *filer_window)
+{
+	if (!filer_window->directory)
+		return;
+
+	dir_set_stat_flags(filer_window->directory,
+			(DirCallback) update_display, filer_window,
+			stat_flags(filer_window));
+}
+
+/* Which optional details (DIRITEM_STAT_*) this window needs */
+static int stat_flags(FilerWindow *filer_window)
+{
+	int	flags = 0;
+
+	if (filer_window->view_type == VIEW_TYPE_DETAILS)
+		flags |= DIRITEM_STAT_GROUP;
+
+	if (filer_window->details_type == DETAILS_TIMES)
+		flags |= DIRITEM_STAT_ATIME;
+	else if (filer_window->details_type == DETAILS_PERMISSIONS)
+		flags |= DIRITEM_STAT_GROUP;
+
+	if (filer_window->sort_type == SORT_GROUP)
+		flags |= DIRITEM_STAT_GROUP;
+	else if (filer_window->sort_type == SORT_TYPE)
+		flags |= DIRITEM_STAT_CONTENTS;	/* Need all the real types */
+
+	return flags;
+}
+
 /* This path has been mounted/umounted/deleted some files - update all dirs */
 void filer_check_mounted(const char *real_path)
 {
@@ -2737,6 +2782,9 @@ gint filer_motion_notify(FilerWindow *filer_window, GdkEventMotion *event)
 		if (item->base_type == TYPE_UNKNOWN)
 			item = dir_update_item(filer_window->directory,
 						item->leafname);
+		if (item && item->flags & ITEM_FLAG_NEED_SNIFF)
+			item = dir_sniff_item(filer_window->directory,
+						item->leafname);
 
 		if (!item)
 		{
@@ -3007,8 +3055,8 @@ gboolean filer_match_filter(FilerWindow *filer_window, DirItem *item)
 
 	switch(filer_window->filter) {
 	case FILER_SHOW_GLOB:
-		return fnmatch(filer_window->filter_string,
-			       item->leafname, 0)==0 ||
+		return pattern_match(filer_window->filter_pattern,
+				     item->leafname) ||
 		  (item->base_type==TYPE_DIRECTORY &&
 		   !filer_window->filter_directories);
 		
@@ -3059,7 +3107,11 @@ gboolean filer_set_filter(FilerWindow *filer_window, FilterType type,
 		g_free(filer_window->filter_string);
 		filer_window->filter_string = NULL;
 	}
-	/* Also clean up compiled regexp when implemented */
+	if (filer_window->filter_pattern)
+	{
+		pattern_free(filer_window->filter_pattern);
+		filer_window->filter_pattern = NULL;
+	}
 
 	filer_window->filter = type;
 
@@ -3071,6 +3123,7 @@ gboolean filer_set_filter(FilerWindow *filer_window, FilterType type,
 
 	case FILER_SHOW_GLOB:
 		filer_window->filter_string = g_strdup(filter_string);
+		filer_window->filter_pattern = pattern_new(filter_string);
 		break;
 
 	default:
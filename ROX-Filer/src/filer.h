@@ -88,10 +88,12 @@ struct _FilerWindow
 	GtkWidget	*minibuffer;		/* The text entry */
 	int		mini_cursor_base;	/* XXX */
 	MiniType	mini_type;
+	GPtrArray	*mini_index;		/* See minibuffer.c */
+	gboolean	mini_index_sorted;
 
 	FilterType      filter;
 	gchar           *filter_string;  /* Glob or regexp pattern */
-	gchar           *regexp;         /* Compiled regexp pattern */
+	Pattern         *filter_pattern; /* Compiled filter_string */
 	/* TRUE if hidden files are shown because the minibuffer leafname
 	 * starts with a dot.
 	 */
@@ -129,6 +131,7 @@ void filer_init(void);
 FilerWindow *filer_opendir(const char *path, FilerWindow *src_win, const gchar *wm_class);
 gboolean filer_update_dir(FilerWindow *filer_window, gboolean warning);
 void filer_update_all(void);
+void filer_update_stat_flags(FilerWindow *filer_window);
 DirItem *filer_selected_item(FilerWindow *filer_window);
 void change_to_parent(FilerWindow *filer_window);
 void full_refresh(void);
@@ -95,6 +95,17 @@ typedef struct _XMLwrapper XMLwrapper;
  */
 typedef struct _CollateKey CollateKey;
 
+/* A compact, precomputed sort key for one item. See sortkey.c. */
+typedef struct _SortKey SortKey;
+
+/* A shell glob, compiled for matching many names. See pattern.c. */
+typedef struct _Pattern Pattern;
+
+/* Allocates lots of small objects (eg, DirItems) which can be freed all
+ * together. See arena.c.
+ */
+typedef struct _Arena Arena;
+
 /* Like a regular GtkLabel, except that the text can be wrapped to any
  * width. Used for pinboard icons.
  */
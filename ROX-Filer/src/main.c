@@ -59,6 +59,7 @@
 #include "options.h"
 #include "choices.h"
 #include "type.h"
+#include "typecache.h"
 #include "pixmaps.h"
 #include "dir.h"
 #include "diritem.h"
@@ -70,6 +71,7 @@
 #include "toolbar.h"
 #include "bind.h"
 #include "panel.h"
+#include "pattern.h"
 #include "session.h"
 #include "minibuffer.h"
 #include "xtypes.h"
@@ -279,6 +281,12 @@ int main(int argc, char **argv)
 		close(fd);
 	}
 
+	/* Directory scanning uses worker threads if possible (see dir.c).
+	 * This must be done before any other GLib calls.
+	 */
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+
 	home_dir = g_get_home_dir();
 	home_dir_len = strlen(home_dir);
 	app_dir = g_strdup(getenv("APP_DIR"));
@@ -348,6 +356,8 @@ int main(int argc, char **argv)
 
 #ifdef UNIT_TESTS
 	bulk_rename_tests();
+	collate_key_tests();
+	pattern_tests();
 #endif
 
 	/* The idea here is to convert the command-line arguments
@@ -605,6 +615,7 @@ int main(int argc, char **argv)
 	display_init();
 	mount_init();
 	type_init();
+	typecache_init();
 	action_init();
 
 	pinboard_init();
@@ -769,6 +769,9 @@ void show_filer_menu(FilerWindow *filer_window, GdkEvent *event, ViewIter *iter)
 				if (item->base_type == TYPE_UNKNOWN)
 					dir_update_item(filer_window->directory,
 							item->leafname);
+				if (item->flags & ITEM_FLAG_NEED_SNIFF)
+					dir_sniff_item(filer_window->directory,
+							item->leafname);
 				shade_file_menu_items(FALSE);
 				file_item = filer_selected_item(filer_window);
 				g_string_printf(buffer, _("%s '%s'"),
@@ -2008,6 +2011,9 @@ static void file_op(gpointer data, FileOp action, GtkWidget *unused)
 	if (item->base_type == TYPE_UNKNOWN)
 		item = dir_update_item(window_with_focus->directory,
 					item->leafname);
+	if (item && item->flags & ITEM_FLAG_NEED_SNIFF)
+		item = dir_sniff_item(window_with_focus->directory,
+					item->leafname);
 
 	if (!item)
 	{
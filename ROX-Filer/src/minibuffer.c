@@ -21,12 +21,12 @@
 
 #include "config.h"
 
-#include <fnmatch.h>
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
 #include <glob.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <sys/types.h>
 #include <pwd.h>
@@ -48,6 +48,7 @@
 #include "diritem.h"
 #include "type.h"
 #include "view_iface.h"
+#include "pattern.h"
 
 static GList *shell_history = NULL;
 
@@ -62,11 +63,19 @@ static gboolean find_next_match(FilerWindow *filer_window,
 static gboolean find_exact_match(FilerWindow *filer_window,
 				 const gchar *pattern);
 static gboolean matches(ViewIter *iter, const char *pattern);
+static GPtrArray *get_index(FilerWindow *filer_window);
+static int sort_by_casefold(const void *a, const void *b);
+static void index_range(GPtrArray *index, const gchar *prefix,
+			int *first, int *last);
+static gboolean cursor_to_nearest(FilerWindow *filer_window,
+				  GPtrArray *index, int first, int last,
+				  int dir);
 static void search_in_dir(FilerWindow *filer_window, int dir);
 static const gchar *mini_contents(FilerWindow *filer_window);
 static void show_help(FilerWindow *filer_window);
 static gboolean grab_focus(GtkWidget *minibuffer);
 static gboolean select_if_glob(ViewIter *iter, gpointer data);
+static void select_by_name(FilerWindow *filer_window, const gchar *glob);
 
 /****************************************************************
  *			EXTERNAL INTERFACE			*
@@ -155,7 +164,7 @@ void minibuffer_show(FilerWindow *filer_window, MiniType mini_type)
 		case MINI_SELECT_BY_NAME:
 			gtk_entry_set_text(mini, "*.");
 			filer_window->mini_cursor_base = -1;	/* History */
-			view_select_if(filer_window->view, select_if_glob, "*.");
+			select_by_name(filer_window, "*.");
 			break;
 		case MINI_FILTER:
 			if(filer_window->filter!=FILER_SHOW_GLOB ||
@@ -208,6 +217,7 @@ void minibuffer_hide(FilerWindow *filer_window)
 	filer_window->mini_type = MINI_NONE;
 
 	gtk_widget_hide(filer_window->minibuffer_area);
+	minibuffer_index_clear(filer_window);
 
 	gtk_widget_child_focus(filer_window->window, GTK_DIR_TAB_FORWARD);
 
@@ -251,6 +261,66 @@ void minibuffer_add(FilerWindow *filer_window, const gchar *leafname)
 	g_free(esc);
 }
 
+/* The path minibuffer searches an index of the items in the view, sorted
+ * by name ignoring case, so that everything matching what has been typed
+ * so far is in one range. The first search creates it; filer.c then keeps
+ * it up to date using these functions until the minibuffer is closed or
+ * the directory is rescanned.
+ */
+void minibuffer_index_add(FilerWindow *filer_window, GPtrArray *items)
+{
+	GPtrArray *index = filer_window->mini_index;
+	int	  i;
+
+	if (!index)
+		return;
+
+	for (i = 0; i < items->len; i++)
+	{
+		DirItem *item = (DirItem *) items->pdata[i];
+
+		if (!filer_match_filter(filer_window, item))
+			continue;
+
+		g_ptr_array_add(index, item);
+		filer_window->mini_index_sorted = FALSE;
+	}
+}
+
+void minibuffer_index_remove(FilerWindow *filer_window, GPtrArray *items)
+{
+	GPtrArray  *index = filer_window->mini_index;
+	GHashTable *gone;
+	int	   i, j;
+
+	if (!index)
+		return;
+
+	gone = g_hash_table_new(NULL, NULL);
+	for (i = 0; i < items->len; i++)
+		g_hash_table_insert(gone, items->pdata[i], items->pdata[i]);
+
+	/* Close up the gaps, keeping the order */
+	j = 0;
+	for (i = 0; i < index->len; i++)
+	{
+		if (!g_hash_table_lookup(gone, index->pdata[i]))
+			index->pdata[j++] = index->pdata[i];
+	}
+	g_ptr_array_set_size(index, j);
+
+	g_hash_table_destroy(gone);
+}
+
+void minibuffer_index_clear(FilerWindow *filer_window)
+{
+	if (filer_window->mini_index)
+	{
+		g_ptr_array_free(filer_window->mini_index, TRUE);
+		filer_window->mini_index = NULL;
+	}
+}
+
 
 /****************************************************************
  *			INTERNAL FUNCTIONS			*
@@ -334,7 +404,9 @@ static void complete(FilerWindow *filer_window)
 	int		shortest_stem = -1;
 	int		current_stem;
 	const gchar	*text, *leaf;
-	ViewIter	cursor, iter;
+	ViewIter	cursor;
+	GPtrArray	*index;
+	int		first, last, i;
 
 	view_get_cursor(filer_window->view, &cursor);
 	item = cursor.peek(&cursor);
@@ -366,13 +438,16 @@ static void complete(FilerWindow *filer_window)
 
 	/* Find the longest other match of this name. If it's longer than
 	 * the currently entered text then complete only up to that length.
+	 * Only the items in the index range can share the entered text.
 	 */
-	view_get_iter(filer_window->view, &iter, 0);
-	while ((other = iter.next(&iter)))
+	index = get_index(filer_window);
+	index_range(index, leaf, &first, &last);
+	for (i = first; i < last; i++)
 	{
 		int	stem = 0;
 
-		if (iter.i == cursor.i)	/* XXX */
+		other = (DirItem *) index->pdata[i];
+		if (other == item)
 			continue;
 
 		while (other->leafname[stem] && item->leafname[stem])
@@ -545,15 +620,20 @@ static void path_changed(FilerWindow *filer_window)
 static gboolean find_exact_match(FilerWindow *filer_window,
 				 const gchar *pattern)
 {
-	DirItem		*item;
+	GPtrArray	*index;
 	ViewIter	iter;
 	ViewIface	*view = filer_window->view;
+	int		first, last, i;
 
-	view_get_iter(view, &iter, 0);
+	index = get_index(filer_window);
+	index_range(index, pattern, &first, &last);
 
-	while ((item = iter.next(&iter)))
+	for (i = first; i < last; i++)
 	{
-		if (strcmp(item->leafname, pattern) == 0)
+		DirItem *item = (DirItem *) index->pdata[i];
+
+		if (strcmp(item->leafname, pattern) == 0 &&
+		    view_find_item(view, &iter, item))
 		{
 			view_cursor_to_iter(view, &iter);
 			return TRUE;
@@ -577,23 +657,44 @@ static gboolean find_next_match(FilerWindow *filer_window,
 {
 	ViewIface  *view = filer_window->view;
 	ViewIter   iter;
+	GPtrArray  *index;
+	int	   n, cost, first, last;
 
-	if (view_count_items(view) < 1)
+	n = view_count_items(view);
+	if (n < 1)
 		return FALSE;
 
-	view_get_iter(view, &iter,
-		VIEW_ITER_FROM_BASE |
-		(dir >= 0 ? 0 : VIEW_ITER_BACKWARDS));
+	index = get_index(filer_window);
+	index_range(index, pattern, &first, &last);
 
-	if (dir != 0)
-		iter.next(&iter);	/* Don't look at the base itself */
+	/* Locating each match in the view is a binary search */
+	for (cost = 1; (1 << cost) < n; cost++)
+		;
 
-	while (iter.next(&iter))
+	if (first == last)
+		;	/* Nothing matches */
+	else if ((last - first) * cost < n)
 	{
-		if (matches(&iter, pattern))
-		{
-			view_cursor_to_iter(view, &iter);
+		if (cursor_to_nearest(filer_window, index, first, last, dir))
 			return TRUE;
+	}
+	else
+	{
+		/* Most items match; just scan the view */
+		view_get_iter(view, &iter,
+			VIEW_ITER_FROM_BASE |
+			(dir >= 0 ? 0 : VIEW_ITER_BACKWARDS));
+
+		if (dir != 0)
+			iter.next(&iter);  /* Don't look at the base itself */
+
+		while (iter.next(&iter))
+		{
+			if (matches(&iter, pattern))
+			{
+				view_cursor_to_iter(view, &iter);
+				return TRUE;
+			}
 		}
 	}
 
@@ -613,7 +714,126 @@ static gboolean matches(ViewIter *iter, const char *pattern)
 	
 	item = iter->peek(iter);
 	
-	return strncasecmp(item->leafname, pattern, strlen(pattern)) == 0;
+	return g_ascii_strncasecmp(item->leafname, pattern,
+				   strlen(pattern)) == 0;
+}
+
+/* Get the index of the view's items, creating or sorting it if needed */
+static GPtrArray *get_index(FilerWindow *filer_window)
+{
+	GPtrArray *index = filer_window->mini_index;
+
+	if (!index)
+	{
+		ViewIface *view = filer_window->view;
+		ViewIter  iter;
+		DirItem	  *item;
+
+		index = g_ptr_array_sized_new(view_count_items(view));
+		view_get_iter(view, &iter, 0);
+		while ((item = iter.next(&iter)))
+			g_ptr_array_add(index, item);
+
+		filer_window->mini_index = index;
+		filer_window->mini_index_sorted = FALSE;
+	}
+
+	if (!filer_window->mini_index_sorted)
+	{
+		qsort(index->pdata, index->len, sizeof(gpointer),
+		      sort_by_casefold);
+		filer_window->mini_index_sorted = TRUE;
+	}
+
+	return index;
+}
+
+static int sort_by_casefold(const void *a, const void *b)
+{
+	const DirItem *item_a = *((const DirItem **) a);
+	const DirItem *item_b = *((const DirItem **) b);
+
+	return g_ascii_strcasecmp(item_a->leafname, item_b->leafname);
+}
+
+/* Set [first, last) to the range of index entries which match 'prefix' */
+static void index_range(GPtrArray *index, const gchar *prefix,
+			int *first, int *last)
+{
+	DirItem	**items = (DirItem **) index->pdata;
+	int	len = strlen(prefix);
+	int	lower, upper;
+
+	lower = 0;
+	upper = index->len;
+	while (lower < upper)
+	{
+		int i = (lower + upper) >> 1;
+
+		if (g_ascii_strncasecmp(items[i]->leafname, prefix, len) < 0)
+			lower = i + 1;
+		else
+			upper = i;
+	}
+	*first = lower;
+
+	upper = index->len;
+	while (lower < upper)
+	{
+		int i = (lower + upper) >> 1;
+
+		if (g_ascii_strncasecmp(items[i]->leafname, prefix, len) > 0)
+			upper = i;
+		else
+			lower = i + 1;
+	}
+	*last = lower;
+}
+
+/* Move the cursor to whichever of the items index[first, last) comes
+ * first when searching the view from the base in direction 'dir' (as for
+ * find_next_match()). FALSE if there is no such item, other than the base.
+ */
+static gboolean cursor_to_nearest(FilerWindow *filer_window,
+				  GPtrArray *index, int first, int last,
+				  int dir)
+{
+	ViewIface *view = filer_window->view;
+	ViewIter  iter, best;
+	int	  n, base, distance, best_distance, i;
+
+	n = view_count_items(view);
+
+	view_get_iter(view, &iter,
+		VIEW_ITER_FROM_BASE | VIEW_ITER_ONE_ONLY |
+		(dir >= 0 ? 0 : VIEW_ITER_BACKWARDS));
+	base = iter.i;
+
+	best_distance = n;
+	for (i = first; i < last; i++)
+	{
+		if (!view_find_item(view, &iter, index->pdata[i]))
+			continue;
+
+		distance = dir >= 0 ? iter.i - base : base - iter.i;
+		if (distance < 0)
+			distance += n;
+		if (distance == 0 && dir != 0)
+			continue;	/* Don't look at the base itself */
+
+		if (distance < best_distance)
+		{
+			best_distance = distance;
+			best = iter;
+		}
+	}
+
+	if (best_distance == n)
+		return FALSE;
+
+	view_cursor_to_iter(view, &best);
+
+	return TRUE;
 }
 
 /* Find next match and set base for future matches. */
@@ -1063,12 +1283,22 @@ static gint key_press_event(GtkWidget	*widget,
 static gboolean select_if_glob(ViewIter *iter, gpointer data)
 {
 	DirItem *item;
-	const char *pattern = (char *) data;
+	Pattern *pattern = (Pattern *) data;
 
 	item = iter->peek(iter);
 	g_return_val_if_fail(item != NULL, FALSE);
 
-	return fnmatch(pattern, item->leafname, 0) == 0;
+	return pattern_match(pattern, item->leafname);
+}
+
+/* Select the items whose names match glob */
+static void select_by_name(FilerWindow *filer_window, const gchar *glob)
+{
+	Pattern *pattern;
+
+	pattern = pattern_new(glob);
+	view_select_if(filer_window->view, select_if_glob, pattern);
+	pattern_free(pattern);
 }
 
 static void changed(GtkEditable *mini, FilerWindow *filer_window)
@@ -1084,9 +1314,7 @@ static void changed(GtkEditable *mini, FilerWindow *filer_window)
 					GTK_ENTRY(filer_window->minibuffer)));
 			return;
 		case MINI_SELECT_BY_NAME:
-			view_select_if(filer_window->view,
-					select_if_glob,
-					(gpointer) gtk_entry_get_text(
+			select_by_name(filer_window, gtk_entry_get_text(
 					      GTK_ENTRY(filer_window->minibuffer)));
 			return;
 		default:
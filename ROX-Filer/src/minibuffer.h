@@ -13,5 +13,8 @@ void create_minibuffer(FilerWindow *filer_window);
 void minibuffer_show(FilerWindow *filer_window, MiniType mini_type);
 void minibuffer_hide(FilerWindow *filer_window);
 void minibuffer_add(FilerWindow *filer_window, const gchar *leafname);
+void minibuffer_index_add(FilerWindow *filer_window, GPtrArray *items);
+void minibuffer_index_remove(FilerWindow *filer_window, GPtrArray *items);
+void minibuffer_index_clear(FilerWindow *filer_window);
 
 #endif /* _MINIBUFFER_H */
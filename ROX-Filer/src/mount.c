@@ -352,6 +352,35 @@ static void read_table(void)
 
 #endif /* DO_MOUNT_POINTS */
 
+/* Returns TRUE if 'dir' is on a network (or FUSE) filesystem, where each
+ * stat() may need a round trip to the server. Only works on Linux; returns
+ * FALSE if we can't tell.
+ */
+gboolean mount_is_remote(const gchar *dir)
+{
+#if defined(HAVE_STATFS) && defined(HAVE_SYS_VFS_H) && defined(__linux__)
+	struct statfs buf;
+
+	if (statfs(dir, &buf) != 0)
+		return FALSE;
+
+	switch ((guint32) buf.f_type)
+	{
+		case 0x6969:		/* NFS */
+		case 0x517B:		/* SMB */
+		case 0xFF534D42:	/* CIFS */
+		case 0xFE534D42:	/* SMB2 */
+		case 0x65735546:	/* FUSE */
+		case 0x73757245:	/* Coda */
+		case 0x5346414F:	/* AFS */
+		case 0x01021997:	/* 9P */
+		case 0x00C36400:	/* Ceph */
+			return TRUE;
+	}
+#endif
+	return FALSE;
+}
+
 gchar *mount_get_fs_size(const gchar *dir)
 {
   int ok=FALSE;
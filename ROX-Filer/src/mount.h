@@ -29,5 +29,6 @@ gboolean mount_is_user_mounted(const gchar *path);
 gboolean mount_is_mounted(const guchar *path, struct stat *info,
 					      struct stat *parent);
 gchar *mount_get_fs_size(const gchar *dir);
+gboolean mount_is_remote(const gchar *dir);
 
 #endif /* _MOUNT_H */
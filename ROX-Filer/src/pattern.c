@@ -0,0 +1,410 @@
+/*
+ * ROX-Filer, filer for the ROX desktop project
+ * Copyright (C) 2006, Thomas Leonard and others (see changelog for details).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* pattern.c - matching leafnames against shell globs */
+
+/* fnmatch() parses the pattern again for every name, and in UTF-8 locales
+ * it converts both strings to wide characters first. When filtering a large
+ * directory the pattern is the same each time, so we parse it just once.
+ *
+ * The common forms ("*.c", "README*", "*foo*", "Makefile") become a single
+ * strcmp(), strncmp() or strstr(). Anything else is split into tokens and
+ * matched without recursion, going back only to the most recent '*' when a
+ * match fails. Patterns using features we don't handle here (eg, named
+ * character classes) are passed to fnmatch().
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <fnmatch.h>
+
+#include "global.h"
+
+#include "pattern.h"
+
+typedef enum {
+	PATTERN_ALL,		/* "*" */
+	PATTERN_EXACT,		/* "lit" */
+	PATTERN_PREFIX,		/* "lit*" */
+	PATTERN_SUFFIX,		/* "*lit" */
+	PATTERN_CONTAINS,	/* "*lit*" */
+	PATTERN_TOKENS,		/* Anything else we can parse */
+	PATTERN_FNMATCH,	/* Anything else */
+} PatternType;
+
+typedef enum {
+	TOKEN_CHAR,		/* A single byte */
+	TOKEN_ANY,		/* "?"; a single (UTF-8) character */
+	TOKEN_CLASS,		/* "[...]" */
+	TOKEN_STAR,		/* "*" */
+} TokenType;
+
+typedef struct _Token Token;
+
+struct _Token {
+	TokenType	type;
+	guchar		c;		/* TOKEN_CHAR */
+	gboolean	negated;	/* TOKEN_CLASS */
+	guint32		set[4];		/* TOKEN_CLASS; ASCII only */
+};
+
+struct _Pattern {
+	PatternType	type;
+	gchar		*glob;		/* PATTERN_FNMATCH */
+	gchar		*literal;	/* The literal types */
+	int		literal_len;
+	Token		*tokens;	/* PATTERN_TOKENS */
+	int		n_tokens;
+};
+
+/* Static prototypes */
+static gboolean parse(const gchar *glob, GArray *tokens);
+static const guchar *parse_class(const guchar *p, Token *token);
+static const guchar *next_char(const guchar *s);
+static gboolean token_matches(const Token *token, const guchar **s);
+static gboolean match_tokens(const Token *tokens, int n, const guchar *s);
+
+
+/****************************************************************
+ *			EXTERNAL INTERFACE			*
+ ****************************************************************/
+
+/* Compile 'glob' (as understood by fnmatch() with no flags) */
+Pattern *pattern_new(const gchar *glob)
+{
+	Pattern	*pattern;
+	GArray	*tokens;
+	GString	*literal;
+	int	first, last, i;
+
+	g_return_val_if_fail(glob != NULL, NULL);
+
+	pattern = g_new(Pattern, 1);
+	pattern->glob = NULL;
+	pattern->literal = NULL;
+	pattern->literal_len = 0;
+	pattern->tokens = NULL;
+	pattern->n_tokens = 0;
+
+	tokens = g_array_new(FALSE, FALSE, sizeof(Token));
+	if (!parse(glob, tokens))
+	{
+		g_array_free(tokens, TRUE);
+		pattern->type = PATTERN_FNMATCH;
+		pattern->glob = g_strdup(glob);
+		return pattern;
+	}
+
+	/* Is it just a literal, with maybe a '*' at either end? */
+	first = 0;
+	last = tokens->len;
+	if (first < last &&
+	    g_array_index(tokens, Token, first).type == TOKEN_STAR)
+		first++;
+	if (first < last &&
+	    g_array_index(tokens, Token, last - 1).type == TOKEN_STAR)
+		last--;
+
+	literal = g_string_new(NULL);
+	for (i = first; i < last; i++)
+	{
+		Token *token = &g_array_index(tokens, Token, i);
+
+		if (token->type != TOKEN_CHAR)
+			break;
+		g_string_append_c(literal, token->c);
+	}
+
+	if (i < last)
+	{
+		pattern->type = PATTERN_TOKENS;
+		pattern->n_tokens = tokens->len;
+		pattern->tokens = (Token *) g_array_free(tokens, FALSE);
+		g_string_free(literal, TRUE);
+		return pattern;
+	}
+
+	if (first == last)
+		pattern->type = first ? PATTERN_ALL : PATTERN_EXACT;
+	else if (first == 0)
+		pattern->type = last < tokens->len ? PATTERN_PREFIX
+						   : PATTERN_EXACT;
+	else
+		pattern->type = last < tokens->len ? PATTERN_CONTAINS
+						   : PATTERN_SUFFIX;
+
+	pattern->literal_len = literal->len;
+	pattern->literal = g_string_free(literal, FALSE);
+	g_array_free(tokens, TRUE);
+
+	return pattern;
+}
+
+/* Returns TRUE if name matches, just as fnmatch(glob, name, 0) == 0 would */
+gboolean pattern_match(const Pattern *pattern, const gchar *name)
+{
+	int	len;
+
+	g_return_val_if_fail(pattern != NULL, FALSE);
+	g_return_val_if_fail(name != NULL, FALSE);
+
+	switch (pattern->type)
+	{
+		case PATTERN_ALL:
+			return TRUE;
+		case PATTERN_EXACT:
+			return strcmp(name, pattern->literal) == 0;
+		case PATTERN_PREFIX:
+			return strncmp(name, pattern->literal,
+					pattern->literal_len) == 0;
+		case PATTERN_SUFFIX:
+			len = strlen(name);
+			return len >= pattern->literal_len &&
+				memcmp(name + len - pattern->literal_len,
+				       pattern->literal,
+				       pattern->literal_len) == 0;
+		case PATTERN_CONTAINS:
+			return strstr(name, pattern->literal) != NULL;
+		case PATTERN_TOKENS:
+			return match_tokens(pattern->tokens, pattern->n_tokens,
+					    (const guchar *) name);
+		case PATTERN_FNMATCH:
+		default:
+			return fnmatch(pattern->glob, name, 0) == 0;
+	}
+}
+
+void pattern_free(Pattern *pattern)
+{
+	g_return_if_fail(pattern != NULL);
+
+	g_free(pattern->glob);
+	g_free(pattern->literal);
+	g_free(pattern->tokens);
+	g_free(pattern);
+}
+
+#ifdef UNIT_TESTS
+static void test_pattern(const char *glob, const char *name)
+{
+	Pattern *pattern;
+	gboolean expected, got;
+
+	pattern = pattern_new(glob);
+	expected = fnmatch(glob, name, 0) == 0;
+	got = pattern_match(pattern, name);
+	pattern_free(pattern);
+
+	if (expected != got)
+		g_print("[ FAIL ] pattern '%s' on '%s' gave %d (expected %d)\n",
+				glob, name, got, expected);
+}
+
+void pattern_tests(void)
+{
+	static const char *globs[] = {
+		"*", "", "*.c", "*.C", "a*", "*a*", "abc", "a?c", "a*c",
+		"*.tar.*", "[abc]*", "[!a]*", "[^a]*", "[a-c]?", "[]x]*",
+		"*[0-9]", "a\\*", "\\a*", "*b*c", "a**b", "?", "??*",
+		"[", "a[", "[[:digit:]]*", "é*", "?x", "*.[ch]", NULL
+	};
+	static const char *names[] = {
+		"", "a", "abc", "abbc", "a.c", "foo.C", "x.tar.gz", "]",
+		"a*", "ab", "dc", "file9", "bxc", "éx", "ex", "main.h",
+		".hidden", "a[", NULL
+	};
+	int	g, n;
+
+	for (g = 0; globs[g]; g++)
+		for (n = 0; names[n]; n++)
+			test_pattern(globs[g], names[n]);
+}
+#endif
+
+/****************************************************************
+ *			INTERNAL FUNCTIONS			*
+ ****************************************************************/
+
+/* Split glob into tokens, joining runs of '*'.
+ * Returns FALSE if fnmatch() should be used instead.
+ */
+static gboolean parse(const gchar *glob, GArray *tokens)
+{
+	const guchar *p = (const guchar *) glob;
+
+	while (*p)
+	{
+		Token	token;
+
+		token.type = TOKEN_CHAR;
+
+		switch (*p)
+		{
+			case '*':
+				token.type = TOKEN_STAR;
+				p++;
+				if (tokens->len && g_array_index(tokens, Token,
+						tokens->len - 1).type ==
+						TOKEN_STAR)
+					continue;
+				break;
+			case '?':
+				token.type = TOKEN_ANY;
+				p++;
+				break;
+			case '[':
+				p = parse_class(p, &token);
+				if (!p)
+					return FALSE;
+				break;
+			case '\\':
+				if (!p[1])
+					return FALSE;
+				token.c = p[1];
+				p += 2;
+				break;
+			default:
+				token.c = *p++;
+				break;
+		}
+
+		g_array_append_val(tokens, token);
+	}
+
+	return TRUE;
+}
+
+/* p points to a '['. Fill in token with the class and return a pointer
+ * to the character after the closing ']', or NULL if we can't handle it.
+ */
+static const guchar *parse_class(const guchar *p, Token *token)
+{
+	int	i;
+
+	token->type = TOKEN_CLASS;
+	token->negated = FALSE;
+	for (i = 0; i < 4; i++)
+		token->set[i] = 0;
+
+	p++;
+	if (*p == '!' || *p == '^')
+	{
+		token->negated = TRUE;
+		p++;
+	}
+
+	/* A ']' straight after the '[' is part of the set */
+	do
+	{
+		guchar	lo, hi, c;
+
+		if (*p == '\0' || *p == '\\' ||
+		    (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')))
+			return NULL;	/* Unterminated, or too complicated */
+		lo = hi = *p;
+		if (p[1] == '-' && p[2] && p[2] != ']')
+		{
+			hi = p[2];
+			p += 2;
+		}
+		if (hi == '\\' || lo >= 0x80 || hi >= 0x80)
+			return NULL;	/* Not ASCII */
+
+		for (c = lo; c <= hi; c++)
+			token->set[c >> 5] |= 1u << (c & 31);
+		p++;
+	} while (*p != ']');
+
+	return p + 1;
+}
+
+static const guchar *next_char(const guchar *s)
+{
+	s++;
+	while ((*s & 0xc0) == 0x80)
+		s++;
+	return s;
+}
+
+/* If the token matches at *s, move *s past it and return TRUE */
+static gboolean token_matches(const Token *token, const guchar **s)
+{
+	const guchar	*p = *s;
+	gboolean	in_set;
+
+	switch (token->type)
+	{
+		case TOKEN_CHAR:
+			if (*p != token->c)
+				return FALSE;
+			*s = p + 1;
+			return TRUE;
+		case TOKEN_ANY:
+			*s = next_char(p);
+			return TRUE;
+		case TOKEN_CLASS:
+			in_set = *p < 0x80 &&
+				(token->set[*p >> 5] & (1u << (*p & 31)));
+			if (in_set == token->negated)
+				return FALSE;
+			*s = next_char(p);
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/* Match s against the tokens. Each '*' first matches nothing; when a
+ * later token fails, the most recent '*' takes one more character and we
+ * try again from there. Earlier stars never need to be revisited.
+ */
+static gboolean match_tokens(const Token *tokens, int n, const guchar *s)
+{
+	const guchar	*star_s = NULL;
+	int		star = -1, t = 0;
+
+	while (*s)
+	{
+		if (t < n && tokens[t].type == TOKEN_STAR)
+		{
+			star = ++t;
+			star_s = s;
+			continue;
+		}
+
+		if (t < n && token_matches(&tokens[t], &s))
+		{
+			t++;
+			continue;
+		}
+
+		if (star < 0)
+			return FALSE;
+
+		t = star;
+		star_s = next_char(star_s);
+		s = star_s;
+	}
+
+	while (t < n && tokens[t].type == TOKEN_STAR)
+		t++;
+
+	return t == n;
+}
@@ -0,0 +1,17 @@
+/*
+ * ROX-Filer, filer for the ROX desktop project
+ * By Thomas Leonard, <tal197@users.sourceforge.net>.
+ */
+
+#ifndef _PATTERN_H
+#define _PATTERN_H
+
+/* Prototypes */
+Pattern *pattern_new(const gchar *glob);
+gboolean pattern_match(const Pattern *pattern, const gchar *name);
+void pattern_free(Pattern *pattern);
+#ifdef UNIT_TESTS
+void pattern_tests(void);
+#endif
+
+#endif /* _PATTERN_H */
@@ -0,0 +1,334 @@
+/*
+ * ROX-Filer, filer for the ROX desktop project
+ * Copyright (C) 2006, Thomas Leonard and others (see changelog for details).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* sortkey.c - sorting large numbers of items quickly */
+
+/* Comparing two DirItems means following pointers into both, and often
+ * comparing strings. Instead, the caller's SortKeyFunc packs the most
+ * significant parts of each item's sort order into a few numbers, and the
+ * items are only compared directly when these are all equal.
+ *
+ * Keys are sorted with a merge sort. Large arrays are split into one chunk
+ * per CPU, which are sorted (and then merged in pairs) by separate threads.
+ * This is only done when there is a SortKeyFunc, since it is expected to
+ * have looked up anything (eg, user names) that the comparison function
+ * would otherwise have to fetch, so that comparisons are safe to make from
+ * other threads.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "global.h"
+
+#include "sortkey.h"
+
+/* Smaller arrays are sorted by a single thread */
+#define PARALLEL_LIMIT 16384
+
+#define MAX_SORT_THREADS 8
+
+/* Runs shorter than this are sorted by insertion */
+#define INSERTION_LIMIT 12
+
+typedef struct _Sorter Sorter;
+
+struct _Sorter {
+	int	(*compar)(const void *, const void *);
+	int	mul;		/* -1 for descending order */
+};
+
+/* A chunk of work for one thread: either sort 'a' using 'tmp', or merge
+ * 'a' and 'b' into 'out'.
+ */
+typedef struct _SortJob SortJob;
+
+struct _SortJob {
+	const Sorter	*sorter;
+	SortKey		*a, *b, *tmp, *out;
+	int		na, nb;
+};
+
+/* Static prototypes */
+static inline int cmp_keys(const Sorter *sorter,
+			   const SortKey *a, const SortKey *b);
+static void merge_sort(const Sorter *sorter, SortKey *a, SortKey *tmp, int n);
+static void parallel_sort(const Sorter *sorter, SortKey *keys, int n,
+			  int n_threads);
+static int sort_threads(int n);
+
+
+/****************************************************************
+ *			EXTERNAL INTERFACE			*
+ ****************************************************************/
+
+/* Sort 'n' keys into 'order', using get_keys (if not NULL) to fill in their
+ * key[] fields, and compar to order items with equal keys. Only the 'data'
+ * fields need to be set on entry; 'index' is set to each key's original
+ * position, so that the caller can rearrange its own array to match.
+ * Returns FALSE (leaving the keys in their original order) if they were
+ * already sorted.
+ */
+gboolean sortkey_sort(SortKey *keys, int n,
+		      int (*compar)(const void *, const void *),
+		      SortKeyFunc get_keys,
+		      GtkSortType order)
+{
+	Sorter	sorter;
+	SortKey	*tmp;
+	int	i, n_threads = 1;
+
+	g_return_val_if_fail(compar != NULL, FALSE);
+
+	sorter.compar = compar;
+	sorter.mul = order == GTK_SORT_ASCENDING ? 1 : -1;
+
+	for (i = 0; i < n; i++)
+	{
+		memset(keys[i].key, 0, sizeof(keys[i].key));
+		keys[i].index = i;
+	}
+
+	if (get_keys)
+	{
+		get_keys(keys, n);
+		n_threads = sort_threads(n);
+	}
+
+	for (i = 1; i < n; i++)
+	{
+		if (cmp_keys(&sorter, &keys[i - 1], &keys[i]) > 0)
+			break;
+	}
+	if (i >= n)
+		return FALSE;	/* Already sorted */
+
+	if (n_threads > 1)
+		parallel_sort(&sorter, keys, n, n_threads);
+	else
+	{
+		tmp = g_new(SortKey, n);
+		merge_sort(&sorter, keys, tmp, n);
+		g_free(tmp);
+	}
+
+	return TRUE;
+}
+
+/****************************************************************
+ *			INTERNAL FUNCTIONS			*
+ ****************************************************************/
+
+static inline int cmp_keys(const Sorter *sorter,
+			   const SortKey *a, const SortKey *b)
+{
+	int	i;
+
+	for (i = 0; i < SORT_KEY_WORDS; i++)
+	{
+		if (a->key[i] != b->key[i])
+			return a->key[i] < b->key[i] ? -sorter->mul
+						     : sorter->mul;
+	}
+
+	return sorter->mul * sorter->compar(a->data, b->data);
+}
+
+/* Merge sorted runs 'a' and 'b' into 'out'. Where keys are equal, those
+ * from 'a' go first.
+ */
+static void merge(const Sorter *sorter,
+		  const SortKey *a, int na,
+		  const SortKey *b, int nb,
+		  SortKey *out)
+{
+	const SortKey *a_end = a + na;
+	const SortKey *b_end = b + nb;
+
+	while (a < a_end && b < b_end)
+	{
+		if (cmp_keys(sorter, b, a) < 0)
+			*out++ = *b++;
+		else
+			*out++ = *a++;
+	}
+
+	if (a < a_end)
+		memcpy(out, a, (a_end - a) * sizeof(SortKey));
+	else if (b < b_end)
+		memcpy(out, b, (b_end - b) * sizeof(SortKey));
+}
+
+/* Sort the 'n' keys at 'src' into 'dst'. Both must start out holding the
+ * same keys; 'src' is used as scratch space.
+ */
+static void sort_into(const Sorter *sorter, SortKey *src, SortKey *dst, int n)
+{
+	int	half;
+
+	if (n <= INSERTION_LIMIT)
+	{
+		int	i, j;
+
+		for (i = 1; i < n; i++)
+		{
+			SortKey key = dst[i];
+
+			for (j = i; j > 0 && cmp_keys(sorter, &key, &dst[j - 1]) < 0;
+			     j--)
+				dst[j] = dst[j - 1];
+			dst[j] = key;
+		}
+		return;
+	}
+
+	/* Sort each half of dst into src, then merge them back */
+	half = n / 2;
+	sort_into(sorter, dst, src, half);
+	sort_into(sorter, dst + half, src + half, n - half);
+
+	if (cmp_keys(sorter, &src[half - 1], &src[half]) <= 0)
+		memcpy(dst, src, n * sizeof(SortKey));
+	else
+		merge(sorter, src, half, src + half, n - half, dst);
+}
+
+/* Sort the 'n' keys at 'a', using 'tmp' (also 'n' long) as scratch space */
+static void merge_sort(const Sorter *sorter, SortKey *a, SortKey *tmp, int n)
+{
+	memcpy(tmp, a, n * sizeof(SortKey));
+	sort_into(sorter, tmp, a, n);
+}
+
+static gpointer sort_job(gpointer data)
+{
+	SortJob	*job = (SortJob *) data;
+
+	if (job->out)
+		merge(job->sorter, job->a, job->na, job->b, job->nb, job->out);
+	else
+		merge_sort(job->sorter, job->a, job->tmp, job->na);
+
+	return NULL;
+}
+
+/* Run each of the 'n_jobs' jobs in its own thread (the first in this one)
+ * and wait for them all to finish.
+ */
+static void run_jobs(SortJob *jobs, int n_jobs)
+{
+	GThread	*threads[MAX_SORT_THREADS];
+	int	i;
+
+	for (i = 1; i < n_jobs; i++)
+	{
+		threads[i] = g_thread_create(sort_job, &jobs[i], TRUE, NULL);
+		if (!threads[i])
+			sort_job(&jobs[i]);
+	}
+
+	sort_job(&jobs[0]);
+
+	for (i = 1; i < n_jobs; i++)
+	{
+		if (threads[i])
+			g_thread_join(threads[i]);
+	}
+}
+
+/* Sort one chunk of keys per thread, then merge the chunks in pairs
+ * (also in parallel) until there is only one left.
+ */
+static void parallel_sort(const Sorter *sorter, SortKey *keys, int n,
+			  int n_threads)
+{
+	SortJob	jobs[MAX_SORT_THREADS];
+	int	start[MAX_SORT_THREADS + 1];
+	SortKey	*tmp, *src, *dst;
+	int	i, width;
+
+	tmp = g_new(SortKey, n);
+
+	for (i = 0; i <= n_threads; i++)
+		start[i] = (int) ((gint64) n * i / n_threads);
+
+	for (i = 0; i < n_threads; i++)
+	{
+		jobs[i].sorter = sorter;
+		jobs[i].a = keys + start[i];
+		jobs[i].tmp = tmp + start[i];
+		jobs[i].na = start[i + 1] - start[i];
+		jobs[i].out = NULL;
+	}
+	run_jobs(jobs, n_threads);
+
+	src = keys;
+	dst = tmp;
+	for (width = 1; width < n_threads; width *= 2)
+	{
+		int	n_jobs = 0;
+
+		for (i = 0; i < n_threads; i += 2 * width)
+		{
+			int	mid = start[MIN(i + width, n_threads)];
+			int	end = start[MIN(i + 2 * width, n_threads)];
+			SortJob	*job = &jobs[n_jobs++];
+
+			job->sorter = sorter;
+			job->a = src + start[i];
+			job->na = mid - start[i];
+			job->b = src + mid;
+			job->nb = end - mid;
+			job->out = dst + start[i];
+		}
+		run_jobs(jobs, n_jobs);
+
+		src = dst;
+		dst = src == keys ? tmp : keys;
+	}
+
+	if (src != keys)
+		memcpy(keys, src, n * sizeof(SortKey));
+
+	g_free(tmp);
+}
+
+/* How many threads to use to sort 'n' keys (a power of two) */
+static int sort_threads(int n)
+{
+	static int max_threads = 0;
+	int	n_threads = 1;
+
+	if (n < PARALLEL_LIMIT || !g_thread_supported())
+		return 1;
+
+	if (!max_threads)
+	{
+		long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		max_threads = CLAMP(n_cpus, 1, MAX_SORT_THREADS);
+	}
+
+	while (n_threads * 2 <= max_threads)
+		n_threads *= 2;
+
+	return n_threads;
+}
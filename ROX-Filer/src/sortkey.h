@@ -0,0 +1,35 @@
+/*
+ * ROX-Filer, filer for the ROX desktop project
+ * By Thomas Leonard, <tal197@users.sourceforge.net>.
+ */
+
+#ifndef _SORTKEY_H
+#define _SORTKEY_H
+
+#include <gtk/gtk.h>
+
+#define SORT_KEY_WORDS 3
+
+struct _SortKey
+{
+	/* Compared in order, as unsigned numbers. If all are equal, the
+	 * items themselves are compared.
+	 */
+	guint64		key[SORT_KEY_WORDS];
+	gpointer	data;		/* The item */
+	gint		index;		/* Position before sorting */
+};
+
+/* Fills in key[] for each of the 'n' keys, from their data. Keys must
+ * sort in the same order as the matching comparison function, although
+ * they may be equal where the items are not.
+ */
+typedef void (*SortKeyFunc)(SortKey *keys, int n);
+
+/* Prototypes */
+gboolean sortkey_sort(SortKey *keys, int n,
+		      int (*compar)(const void *, const void *),
+		      SortKeyFunc get_keys,
+		      GtkSortType order);
+
+#endif /* _SORTKEY_H */
@@ -37,7 +37,11 @@
 #include <unistd.h>
 #include <libxml/parser.h>
 #include <math.h>
+#include <utime.h>
 #include <sys/mman.h>
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 
 #include "global.h"
 
@@ -48,12 +52,23 @@
 #include "fscache.h"
 #include "main.h"
 #include "xml.h"
+#include "arena.h"
+#include "xtypes.h"
 
 static GHashTable *uid_hash = NULL;	/* UID -> User name */
 static GHashTable *gid_hash = NULL;	/* GID -> Group name */
 
 /* Static prototypes */
 static void MD5Transform(guint32 buf[4], guint32 const in[16]);
+static int copy_data(int in, int out, const struct stat *info);
+static int copy_sparse(int in, int out, off_t size);
+static int copy_range(int in, int out, off_t len, gboolean sparse);
+static gboolean all_zero(const char *buffer, ssize_t len);
+static gboolean kernel_copy_unsupported(int error);
+static guchar *copy_special(const guchar *from, const guchar *to,
+			    struct stat *info);
+static guchar *copy_tree(const guchar *from, const guchar *to);
+static guchar *remove_tree(const guchar *path);
 
 /****************************************************************
  *			EXTERNAL INTERFACE			*
@@ -583,22 +598,492 @@ char *pretty_time(const time_t *time)
 #  define O_NOFOLLOW 0x0
 #endif
 
+#define COPY_CHUNK (1 << 30)		/* Most to ask the kernel for at once */
+#define COPY_BUFFER_SIZE (128 * 1024)	/* For read() and write() */
+
+/* How much to ask the kernel for, with 'left' bytes to go (-1 => all) */
+#define COPY_SIZE(left) \
+	((left) < 0 || (left) > COPY_CHUNK ? COPY_CHUNK : (size_t) (left))
+
+/* Copy 'in' to 'out', both at offset 0. 'info' is the lstat() of 'in'.
+ * Returns 0 on success, or -1 with errno set.
+ */
+static int copy_data(int in, int out, const struct stat *info)
+{
+	/* Fewer blocks than the size needs => there are holes to keep */
+	if ((off_t) info->st_blocks * 512 < info->st_size)
+		return copy_sparse(in, out, info->st_size);
+
+	return copy_range(in, out, -1, FALSE);
+}
+
+/* Copy a file with holes in it, without filling them in (the kernel
+ * methods write holes out as zeros). If the filesystem can tell us where
+ * the data is, only copy that. Otherwise, read the whole file and skip
+ * over blocks of zeros when writing.
+ */
+static int copy_sparse(int in, int out, off_t size)
+{
+#ifdef SEEK_DATA
+	off_t	data, hole = 0;
+
+	for (;;)
+	{
+		data = lseek(in, hole, SEEK_DATA);
+		if (data < 0)
+		{
+			if (errno == ENXIO)
+				break;		/* Only holes after 'hole' */
+			if (hole == 0 && errno == EINVAL)
+				goto no_seek_data;
+			return -1;
+		}
+
+		hole = lseek(in, data, SEEK_HOLE);
+		if (hole < 0 || lseek(in, data, SEEK_SET) < 0 ||
+		    lseek(out, data, SEEK_SET) < 0)
+			return -1;
+
+		if (copy_range(in, out, hole - data, FALSE))
+			return -1;
+	}
+
+	return ftruncate(out, size);
+
+no_seek_data:
+#endif
+	if (copy_range(in, out, -1, TRUE))
+		return -1;
+
+	/* In case the file ends with a skipped block */
+	size = lseek(out, 0, SEEK_CUR);
+	if (size < 0)
+		return -1;
+	return ftruncate(out, size);
+}
+
+/* Copy 'len' bytes (or the rest of the file if 'len' is -1) from 'in' to
+ * 'out', from their current offsets.
+ * The kernel can copy the data itself with copy_file_range() (which may
+ * even share the blocks, on filesystems which support it) or with
+ * sendfile(). If neither works for these files, or 'sparse' is set, we
+ * read() and write(). With 'sparse', blocks of zeros are skipped rather
+ * than written, leaving holes in 'out'; the caller must set its size.
+ * Returns 0 on success, or -1 with errno set.
+ */
+static int copy_range(int in, int out, off_t len, gboolean sparse)
+{
+	gboolean copied = FALSE;
+	ssize_t	got;
+	char	*buffer;
+	int	result = 0;
+	off_t	left = len;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	if (!sparse)
+	{
+		do
+		{
+			got = copy_file_range(in, NULL, out, NULL,
+					      COPY_SIZE(left), 0);
+			if (got > 0)
+			{
+				copied = TRUE;
+				if (left > 0)
+					left -= got;
+			}
+		} while ((got > 0 && left != 0) ||
+			 (got < 0 && errno == EINTR));
+
+		/* Files in /proc, etc, claim to be empty, so if we didn't
+		 * get anything then check with the next method.
+		 */
+		if (left == 0 || (got == 0 && copied))
+			return 0;
+		if (got < 0 && !kernel_copy_unsupported(errno))
+			return -1;
+	}
+#endif
+
+#ifdef HAVE_SENDFILE
+	if (!sparse)
+	{
+		do
+		{
+			got = sendfile(out, in, NULL, COPY_SIZE(left));
+			if (got > 0)
+			{
+				copied = TRUE;
+				if (left > 0)
+					left -= got;
+			}
+		} while ((got > 0 && left != 0) ||
+			 (got < 0 && errno == EINTR));
+
+		if (left == 0 || (got == 0 && copied))
+			return 0;
+		if (got < 0 && !kernel_copy_unsupported(errno))
+			return -1;
+	}
+#endif
+
+	buffer = g_malloc(COPY_BUFFER_SIZE);
+
+	while (left != 0)
+	{
+		char	*p = buffer;
+
+		got = read(in, buffer, left < 0 || left > COPY_BUFFER_SIZE
+				       ? COPY_BUFFER_SIZE : left);
+		if (got == 0)
+			break;
+		if (got < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			result = -1;
+			break;
+		}
+		if (left > 0)
+			left -= got;
+
+		if (sparse && all_zero(buffer, got))
+		{
+			if (lseek(out, got, SEEK_CUR) < 0)
+			{
+				result = -1;
+				break;
+			}
+			continue;
+		}
+
+		while (got > 0)
+		{
+			ssize_t	done;
+
+			done = write(out, p, got);
+			if (done < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				result = -1;
+				break;
+			}
+			p += done;
+			got -= done;
+		}
+
+		if (result)
+			break;
+	}
+
+	g_free(buffer);
+
+	return result;
+}
+
+static gboolean all_zero(const char *buffer, ssize_t len)
+{
+	return len > 0 && buffer[0] == '\0' &&
+		memcmp(buffer, buffer + 1, len - 1) == 0;
+}
+
+/* TRUE if this error from copy_file_range() or sendfile() means that it
+ * can't be used for these files (rather than that the copy failed).
+ */
+static gboolean kernel_copy_unsupported(int error)
+{
+	switch (error)
+	{
+		case ENOSYS:
+		case EINVAL:
+		case EXDEV:
+		case EOPNOTSUPP:
+#if defined(ENOTSUP) && ENOTSUP != EOPNOTSUPP
+		case ENOTSUP:
+#endif
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Make a copy of a device, FIFO or socket, as 'cp -R' does */
+static guchar *copy_special(const guchar *from, const guchar *to,
+			    struct stat *info)
+{
+	struct utimbuf utb;
+	mode_t	mode = info->st_mode & 07777;
+
+	if (!(S_ISCHR(info->st_mode) || S_ISBLK(info->st_mode) ||
+	      S_ISFIFO(info->st_mode) || S_ISSOCK(info->st_mode)))
+		return g_strdup_printf(_("Can't copy '%s': %s"),
+				from, _("Not a regular file"));
+
+	if (mknod(to, info->st_mode & S_IFMT, info->st_rdev) &&
+	    !(errno == EEXIST && unlink(to) == 0 &&
+	      mknod(to, info->st_mode & S_IFMT, info->st_rdev) == 0))
+		return g_strdup_printf(_("Can't create '%s': %s"),
+					to, g_strerror(errno));
+
+	if (lchown(to, info->st_uid, info->st_gid))
+		mode &= ~(S_ISUID | S_ISGID);
+	chmod(to, mode);
+
+	utb.actime = info->st_atime;
+	utb.modtime = info->st_mtime;
+	utime(to, &utb);
+
+	return NULL;
+}
+
 /* 'from' and 'to' are complete pathnames of files (not dirs or symlinks).
- * This spawns 'cp' to do the copy if lstat() succeeds, otherwise we
- * do the copy manually using vfs.
+ * Copies the contents, and preserves the mode, ownership, times and
+ * extended attributes where possible (like 'cp -pf' did, but without
+ * starting a new process for every file).
  *
  * Returns an error string, or NULL on success. g_free() the result.
- *
- * XXX: This was only used for libvfs...
  */
 guchar *copy_file(const guchar *from, const guchar *to)
 {
-	const char *argv[] = {"cp", "-pRf", NULL, NULL, NULL};
+	struct stat	info;
+	mode_t		mode;
+	guchar		*error = NULL;
+	int		in, out;
+
+	if (mc_lstat(from, &info))
+		return g_strdup_printf(_("Can't read '%s': %s"),
+					from, g_strerror(errno));
+
+	if (!S_ISREG(info.st_mode))
+		return copy_special(from, to, &info);
+
+	in = open(from, O_RDONLY | O_NOFOLLOW);
+	if (in == -1)
+		return g_strdup_printf(_("Can't read '%s': %s"),
+					from, g_strerror(errno));
+
+	/* Only we can read the new file until the copy is complete */
+	out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (out == -1 && errno != ENOENT && unlink(to) == 0)
+		out = open(to, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	if (out == -1)
+	{
+		error = g_strdup_printf(_("Can't create '%s': %s"),
+					to, g_strerror(errno));
+		close(in);
+		return error;
+	}
+
+	if (copy_data(in, out, &info))
+		error = g_strdup_printf(_("Error copying to '%s': %s"),
+					to, g_strerror(errno));
+	else
+	{
+		mode = info.st_mode & 07777;
+
+		/* Only root can give files away. The copy will be ours, so
+		 * don't let it keep the source's SetUID and SetGID bits.
+		 */
+		if (fchown(out, info.st_uid, info.st_gid))
+			mode &= ~(S_ISUID | S_ISGID);
 
-	argv[2] = from;
-	argv[3] = to;
+		/* Not all filesystems support these. Do it while the
+		 * file is still writable, or a read-only source would lose
+		 * its user.* attributes.
+		 */
+		xattr_copy(from, to);
+
+		if (fchmod(out, mode) && errno != EPERM)
+			error = g_strdup_printf(
+					_("Can't set permissions of '%s': %s"),
+					to, g_strerror(errno));
+
+#ifdef HAVE_FUTIMENS
+		{
+			struct timespec times[2];
 
-	return fork_exec_wait(argv);
+			times[0] = info.st_atim;
+			times[1] = info.st_mtim;
+			futimens(out, times);
+		}
+#endif
+	}
+
+	/* (network filesystems may only report write errors now) */
+	if (close(out) && !error)
+		error = g_strdup_printf(_("Error copying to '%s': %s"),
+					to, g_strerror(errno));
+	close(in);
+
+#ifndef HAVE_FUTIMENS
+	if (!error)
+	{
+		struct utimbuf utb;
+
+		utb.actime = info.st_atime;
+		utb.modtime = info.st_mtime;
+		utime(to, &utb);
+	}
+#endif
+
+	return error;
+}
+
+/* Move 'from' to 'to', which must not already exist. Within a filesystem
+ * this is just a rename. Otherwise, 'from' (and everything in it, for a
+ * directory) is copied and then the original is removed, as mv(1) does.
+ *
+ * Returns an error string, or NULL on success. g_free() the result.
+ */
+guchar *move_file(const guchar *from, const guchar *to)
+{
+	guchar	*error;
+	int	err;
+
+#if defined(HAVE_RENAMEAT2) && defined(RENAME_NOREPLACE)
+	/* Don't replace anything created since the caller checked */
+	err = renameat2(AT_FDCWD, from, AT_FDCWD, to, RENAME_NOREPLACE);
+	if (err && (errno == ENOSYS || errno == EINVAL))
+		err = rename(from, to);	/* Flag not supported here */
+#else
+	err = rename(from, to);
+#endif
+	if (err == 0)
+		return NULL;
+
+	if (errno != EXDEV)
+		return g_strdup_printf(_("Can't move '%s': %s"),
+					from, g_strerror(errno));
+
+	/* Only remove the original once we have a complete copy */
+	error = copy_tree(from, to);
+	if (!error)
+		error = remove_tree(from);
+
+	return error;
+}
+
+/* Copy 'from' to 'to', recursively, preserving what we can. For
+ * move_file(), so there are no questions and the first error stops it.
+ */
+static guchar *copy_tree(const guchar *from, const guchar *to)
+{
+	struct stat	info;
+	struct utimbuf	utb;
+	guchar		*error = NULL;
+	DIR		*d;
+	struct dirent	*ent;
+	mode_t		mode;
+
+	if (mc_lstat(from, &info))
+		return g_strdup_printf(_("Can't read '%s': %s"),
+					from, g_strerror(errno));
+
+	if (S_ISLNK(info.st_mode))
+	{
+		char	*target;
+
+		target = readlink_dup(from);
+		if (!target)
+			return g_strdup_printf(_("Can't read '%s': %s"),
+						from, g_strerror(errno));
+		if (symlink(target, to))
+			error = g_strdup_printf(_("Can't create '%s': %s"),
+						to, g_strerror(errno));
+		else
+			lchown(to, info.st_uid, info.st_gid);
+		g_free(target);
+
+		return error;
+	}
+
+	if (!S_ISDIR(info.st_mode))
+		return copy_file(from, to);
+
+	if (mkdir(to, 0700))
+		return g_strdup_printf(_("Can't create '%s': %s"),
+					to, g_strerror(errno));
+
+	d = mc_opendir(from);
+	if (!d)
+		return g_strdup_printf(_("Can't read '%s': %s"),
+					from, g_strerror(errno));
+
+	while (!error && (ent = mc_readdir(d)))
+	{
+		gchar	*sub_from, *sub_to;
+
+		if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0'
+			|| (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
+			continue;
+
+		sub_from = g_build_filename(from, ent->d_name, NULL);
+		sub_to = g_build_filename(to, ent->d_name, NULL);
+		error = copy_tree(sub_from, sub_to);
+		g_free(sub_from);
+		g_free(sub_to);
+	}
+	mc_closedir(d);
+
+	/* Now that the contents are in, give it the source's details */
+	mode = info.st_mode & 07777;
+	if (lchown(to, info.st_uid, info.st_gid))
+		mode &= ~(S_ISUID | S_ISGID);
+	xattr_copy(from, to);	/* Before it stops being writable */
+	chmod(to, mode);
+
+	utb.actime = info.st_atime;
+	utb.modtime = info.st_mtime;
+	utime(to, &utb);
+
+	return error;
+}
+
+/* Delete 'path', and everything in it if it's a directory */
+static guchar *remove_tree(const guchar *path)
+{
+	struct stat	info;
+	guchar		*error = NULL;
+	DIR		*d;
+	struct dirent	*ent;
+
+	if (mc_lstat(path, &info))
+		return g_strdup_printf(_("Can't read '%s': %s"),
+					path, g_strerror(errno));
+
+	if (!S_ISDIR(info.st_mode))
+	{
+		if (unlink(path))
+			return g_strdup_printf(_("Can't delete '%s': %s"),
+						path, g_strerror(errno));
+		return NULL;
+	}
+
+	d = mc_opendir(path);
+	if (!d)
+		return g_strdup_printf(_("Can't read '%s': %s"),
+					path, g_strerror(errno));
+
+	while (!error && (ent = mc_readdir(d)))
+	{
+		gchar	*sub;
+
+		if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0'
+			|| (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
+			continue;
+
+		sub = g_build_filename(path, ent->d_name, NULL);
+		error = remove_tree(sub);
+		g_free(sub);
+	}
+	mc_closedir(d);
+
+	if (!error && rmdir(path))
+		error = g_strdup_printf(_("Can't delete '%s': %s"),
+					path, g_strerror(errno));
+
+	return error;
 }
 
 /* 'word' has all special characters escaped so that it may be inserted
@@ -1162,17 +1647,55 @@ void null_g_free(gpointer p)
 	*(gpointer *)p = NULL;
 }
 
-typedef struct _CollatePart CollatePart;
-
+/* A CollateKey is a single block of memory: this header, followed by 'len'
+ * bytes which can be compared with memcmp() to sort names intelligently.
+ *
+ * The name is broken into (text, number) parts. Each part is encoded as
+ * the collation key of the lowercased text (including its terminating
+ * NUL, so that a shorter text sorts first), followed by the number.
+ * A number is stored as a count of bytes (1 to sizeof(long)) followed by
+ * the value in big-endian order, so that larger numbers sort later. The
+ * last part has no number, which is stored as a zero count (sorting before
+ * any number).
+ */
 struct _CollateKey {
-	CollatePart *parts;
 	gboolean caps;
+	guint len;
 };
 
-struct _CollatePart {
-	guchar *text;	/* NULL => end of list */
-	long number;
-};
+#define COLLATE_KEY_BYTES(key) ((const guchar *) ((key) + 1))
+
+/* Append the collation key for 'len' bytes of 'text' to 'bytes' */
+static void collate_append_text(GByteArray *bytes, const guchar *text, int len)
+{
+	gchar *tmp, *key;
+
+	tmp = g_utf8_strdown(text, len);
+	key = g_utf8_collate_key(tmp, -1);
+	g_byte_array_append(bytes, key, strlen(key) + 1);
+	g_free(key);
+	g_free(tmp);
+}
+
+/* Append a number to 'bytes'. -1 means no number. */
+static void collate_append_number(GByteArray *bytes, long number)
+{
+	guint8	buf[sizeof(long) + 1];
+	int	n = 0;
+
+	if (number >= 0)
+	{
+		do
+		{
+			buf[sizeof(long) - n] = number & 0xff;
+			number >>= 8;
+			n++;
+		} while (number);
+	}
+
+	buf[sizeof(long) - n] = n;
+	g_byte_array_append(bytes, buf + sizeof(long) - n, n + 1);
+}
 
 /* Break 'name' (a UTF-8 string) down into a list of (text, number) pairs.
  * The text parts processed for collating. This allows any two names to be
@@ -1180,17 +1703,25 @@ struct _CollatePart {
  * speed-critical).
  */
 CollateKey *collate_key_new(const guchar *name)
+{
+	return collate_key_new_in(NULL, name);
+}
+
+/* As collate_key_new(), but the key is allocated from 'arena' (or from
+ * g_malloc() if arena is NULL). Free with arena_free() in the first case,
+ * or collate_key_free() in the second.
+ */
+CollateKey *collate_key_new_in(Arena *arena, const guchar *name)
 {
 	const guchar *i;
 	guchar *to_free = NULL;
-	GArray *array;
-	CollatePart new;
+	GByteArray *bytes;
 	CollateKey *retval;
-	char *tmp;
+	gboolean caps;
 
 	g_return_val_if_fail(name != NULL, NULL);
 
-	array = g_array_new(FALSE, FALSE, sizeof(CollatePart));
+	bytes = g_byte_array_new();
 
 	/* Ensure valid UTF-8 */
 	if (!g_utf8_validate(name, -1, NULL))
@@ -1199,8 +1730,7 @@ CollateKey *collate_key_new(const guchar *name)
 		name = to_free;
 	}
 
-	retval = g_new(CollateKey, 1);
-	retval->caps = g_unichar_isupper(g_utf8_get_char(name));
+	caps = g_unichar_isupper(g_utf8_get_char(name));
 
 	for (i = name; *i; i = g_utf8_next_char(i))
 	{
@@ -1215,14 +1745,12 @@ CollateKey *collate_key_new(const guchar *name)
 		if (first_char >= '0' && first_char <= '9')
 		{
 			char *endp;
+			long number;
 			
 			/* i -> first digit character */
-			tmp = g_utf8_strdown(name, i - name);
-			new.text = g_utf8_collate_key(tmp, -1);
-			g_free(tmp);
-			new.number = strtol(i, &endp, 10);
-
-			g_array_append_val(array, new);
+			collate_append_text(bytes, name, i - name);
+			number = strtol(i, &endp, 10);
+			collate_append_number(bytes, number);
 
 			g_return_val_if_fail(endp > (char *) i, NULL);
 
@@ -1231,17 +1759,16 @@ CollateKey *collate_key_new(const guchar *name)
 		}
 	}
 
-	tmp = g_utf8_strdown(name, i - name);
-	new.text = g_utf8_collate_key(tmp, -1);
-	g_free(tmp);
-	new.number = -1;
-	g_array_append_val(array, new);
+	collate_append_text(bytes, name, i - name);
+	collate_append_number(bytes, -1);
 
-	new.text = NULL;
-	g_array_append_val(array, new);
+	retval = arena ? arena_alloc(arena, sizeof(CollateKey) + bytes->len)
+		       : g_malloc(sizeof(CollateKey) + bytes->len);
+	retval->caps = caps;
+	retval->len = bytes->len;
+	memcpy(retval + 1, bytes->data, bytes->len);
 
-	retval->parts = (CollatePart *) array->data;
-	g_array_free(array, FALSE);
+	g_byte_array_free(bytes, TRUE);
 
 	if (to_free)
 		g_free(to_free);	/* Only taken for invalid UTF-8 */
@@ -1251,19 +1778,34 @@ CollateKey *collate_key_new(const guchar *name)
 
 void collate_key_free(CollateKey *key)
 {
-	CollatePart *part;
-
-	for (part = key->parts; part->text; part++)
-		g_free(part->text);
-	g_free(key->parts);
 	g_free(key);
 }
 
+/* The first eight bytes of the key, as a number. If two keys have
+ * different prefixes then comparing the prefixes gives the same result as
+ * collate_key_cmp() (ignoring caps_first).
+ */
+guint64 collate_key_prefix(const CollateKey *key)
+{
+	const guchar *bytes = COLLATE_KEY_BYTES(key);
+	guint64 prefix = 0;
+	guint i;
+
+	for (i = 0; i < 8; i++)
+		prefix = (prefix << 8) | (i < key->len ? bytes[i] : 0);
+
+	return prefix;
+}
+
+/* TRUE if the name started with a capital letter (for caps_first sorting) */
+gboolean collate_key_caps(const CollateKey *key)
+{
+	return key->caps;
+}
+
 int collate_key_cmp(const CollateKey *key1, const CollateKey *key2,
 		    gboolean caps_first)
 {
-	CollatePart *n1 = key1->parts;
-	CollatePart *n2 = key2->parts;
 	int r;
 
 	if (caps_first)
@@ -1274,26 +1816,55 @@ int collate_key_cmp(const CollateKey *key1, const CollateKey *key2,
 			return 1;
 	}
 
-	while (1)
-	{
-		if (!n1->text)
-			return n2->text ? -1 : 0;
-		if (!n2->text)
-			return 1;
-		r = strcmp(n1->text, n2->text);
-		if (r)
-			return r;
+	r = memcmp(COLLATE_KEY_BYTES(key1), COLLATE_KEY_BYTES(key2),
+		   MIN(key1->len, key2->len));
+	if (r)
+		return r;
 
-		if (n1->number < n2->number)
-			return -1;
-		if (n1->number > n2->number)
-			return 1;
+	return key1->len < key2->len ? -1 :
+	       key1->len > key2->len ? 1 : 0;
+}
 
-		n1++;
-		n2++;
-	}
+#ifdef UNIT_TESTS
+static void test_collate(const char *name1, const char *name2, int expected)
+{
+	CollateKey *key1, *key2;
+	int r;
+
+	g_print("Testing collate('%s', '%s')\n", name1, name2);
+
+	key1 = collate_key_new(name1);
+	key2 = collate_key_new(name2);
+
+	r = collate_key_cmp(key1, key2, FALSE);
+	r = r < 0 ? -1 : r > 0 ? 1 : 0;
+	g_return_if_fail(r == expected);
+
+	/* The prefix must agree with the full comparison */
+	if (collate_key_prefix(key1) != collate_key_prefix(key2))
+		g_return_if_fail((collate_key_prefix(key1) <
+				  collate_key_prefix(key2)) == (r < 0));
+
+	collate_key_free(key1);
+	collate_key_free(key2);
 }
 
+void collate_key_tests(void)
+{
+	test_collate("file", "file", 0);
+	test_collate("file", "file1", -1);
+	test_collate("file2", "file10", -1);
+	test_collate("file10", "file9", 1);
+	test_collate("file1", "file01", 0);
+	test_collate("file1.txt", "file10", -1);
+	test_collate("x255", "x256", -1);
+	test_collate("x65535", "x65536", -1);
+	test_collate("abc", "abd", -1);
+	test_collate("a10b", "a10a", 1);
+	test_collate("", "a", -1);
+}
+#endif
+
 /* Returns TRUE if the object exists, FALSE if it doesn't.
  * For symlinks, the file pointed to must exist.
  */
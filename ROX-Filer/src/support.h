@@ -32,6 +32,7 @@ void close_on_exec(int fd, gboolean close);
 void set_blocking(int fd, gboolean blocking);
 char *pretty_time(const time_t *time);
 guchar *copy_file(const guchar *from, const guchar *to);
+guchar *move_file(const guchar *from, const guchar *to);
 guchar *shell_escape(const guchar *word);
 gboolean is_sub_dir(const char *sub, const char *parent);
 gboolean in_list(const guchar *item, const guchar *list);
@@ -47,7 +48,13 @@ gchar *expand_path(const gchar *path);
 void destroy_glist(GList **list);
 void null_g_free(gpointer p);
 CollateKey *collate_key_new(const guchar *name);
+CollateKey *collate_key_new_in(Arena *arena, const guchar *name);
 void collate_key_free(CollateKey *key);
+guint64 collate_key_prefix(const CollateKey *key);
+gboolean collate_key_caps(const CollateKey *key);
+#ifdef UNIT_TESTS
+void collate_key_tests(void);
+#endif
 int collate_key_cmp(const CollateKey *n1, const CollateKey *n2,
 		    gboolean caps_first);
 gboolean file_exists(const char *path);
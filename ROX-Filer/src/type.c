@@ -305,6 +305,15 @@ MIME_type *type_get_type(const guchar *path)
  * NULL if we can't think of anything.
  */
 MIME_type *type_from_path(const char *path)
+{
+	return type_from_stat(path, NULL);
+}
+
+/* As type_from_path(), but 'info' is the result of stat()ing 'path', if
+ * the caller already has it. This saves looking the file up again before
+ * reading its contents.
+ */
+MIME_type *type_from_stat(const char *path, struct stat *info)
 {
 	MIME_type *mime_type = NULL;
 	const char *type_name;
@@ -315,13 +324,38 @@ MIME_type *type_from_path(const char *path)
 		return mime_type;
 
 	/* Try name and contents next */
-	type_name = xdg_mime_get_mime_type_for_file(path, NULL);
+	type_name = xdg_mime_get_mime_type_for_file(path, info);
 	if (type_name)
 		return get_mime_type(type_name, TRUE);
 
 	return NULL;
 }
 
+/* As type_from_path(), but never reads the file's contents. If the contents
+ * might give a different answer, *need_sniff is set to TRUE and the result
+ * is only a guess based on the name (NULL if there isn't one).
+ */
+MIME_type *type_from_name(const char *path, gboolean *need_sniff)
+{
+	MIME_type *mime_type;
+	const char *type_names[2];
+	int n;
+
+	*need_sniff = FALSE;
+
+	mime_type = xtype_get(path);
+	if (mime_type)
+		return mime_type;
+
+	n = xdg_mime_get_mime_types_from_file_name(path, type_names, 2);
+	if (n != 1)
+		*need_sniff = TRUE;
+	if (n > 0)
+		return get_mime_type(type_names[0], TRUE);
+
+	return NULL;
+}
+
 /* Returns the file/dir in Choices for handling this type.
  * NULL if there isn't one. g_free() the result.
  */
@@ -7,6 +7,7 @@
 #define _TYPE_H
 
 #include <gtk/gtk.h>
+#include <sys/stat.h>
 
 extern MIME_type *text_plain;		/* Often used as a default type */
 extern MIME_type *inode_directory;
@@ -40,6 +41,8 @@ const char *basetype_name(DirItem *item);
 MIME_type *type_get_type(const guchar *path);
 
 MIME_type *type_from_path(const char *path);
+MIME_type *type_from_stat(const char *path, struct stat *info);
+MIME_type *type_from_name(const char *path, gboolean *need_sniff);
 MaskedPixmap *type_to_icon(MIME_type *type);
 GdkAtom type_to_atom(MIME_type *type);
 MIME_type *mime_type_from_base_type(int base_type);
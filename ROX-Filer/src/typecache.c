@@ -0,0 +1,520 @@
+/*
+ * ROX-Filer, filer for the ROX desktop project
+ * Copyright (C) 2006, Thomas Leonard and others (see changelog for details).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* typecache.c - remembering the types of files between runs */
+
+/* Working out the type of a file may mean reading its contents, which is
+ * slow when a directory contains thousands of files. We keep the results
+ * in a file under the user's cache directory, which is mapped into memory.
+ *
+ * The file is a fixed-size hash table. Each record is keyed on the file's
+ * device, inode, size, mtime and ctime, and a hash of its name (since hard
+ * links may have different extensions). If any of these change, the record
+ * no longer matches and the type is worked out again. When a slot is
+ * needed and all the nearby ones are full, one is simply overwritten;
+ * this is only a cache.
+ *
+ * Types are stored as an index into a table of type names in the header.
+ * The header also records the modification time of the MIME database;
+ * if the database changes, the whole cache is discarded. This is done by
+ * changing the header's generation number, which is part of every record's
+ * check value, so that the file never has to be truncated while another
+ * copy of the filer may have it mapped.
+ *
+ * Two copies may also add different names to the same slot of the type
+ * table at once, so the check value includes a hash of the type's name
+ * too. A record whose slot now holds some other name is simply invalid.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "global.h"
+
+#include "main.h"
+#include "options.h"
+#include "support.h"
+#include "type.h"
+#include "diritem.h"
+#include "xdgmime.h"
+#include "typecache.h"
+
+#define TYPECACHE_MAGIC "ROX-Filer types\n"	/* 16 bytes */
+#define TYPECACHE_VERSION 1
+#define TYPECACHE_SLOTS (1 << 18)	/* Must be a power of two */
+#define TYPECACHE_PROBE 8		/* Slots to try for each key */
+#define MAX_TYPES 1024
+#define MAX_TYPE_NAME 64
+
+/* ItemFlags which can be stored in the cache */
+#define CACHED_FLAGS (ITEM_FLAG_EXEC_FILE)
+
+typedef struct _CacheHeader CacheHeader;
+typedef struct _CacheRecord CacheRecord;
+
+struct _CacheHeader
+{
+	char	magic[16];
+	guint32	version;
+	guint32	record_size;
+	guint32	n_slots;
+	guint32	n_types;
+	guint32	generation;		/* Changed by cache_reset() */
+	guint32	pad;
+	gint64	database_mtime;		/* See xdg_mime_get_database_mtime() */
+	char	types[MAX_TYPES][MAX_TYPE_NAME];
+};
+
+struct _CacheRecord
+{
+	guint64	dev, ino;
+	gint64	size, mtime, ctime;
+	guint32	name_hash;
+	guint16	type;			/* 0 => empty; else index + 1 */
+	guint16	flags;			/* CACHED_FLAGS only */
+	guint32	check;			/* record_check() */
+	guint32	pad;
+};
+
+#define CACHE_SIZE (sizeof(CacheHeader) + \
+			TYPECACHE_SLOTS * sizeof(CacheRecord))
+
+static Option o_type_cache;
+
+static CacheHeader *header = NULL;	/* NULL => not mapped */
+static CacheRecord *records = NULL;
+static gboolean tried_open = FALSE;	/* Don't keep trying if it fails */
+
+/* header->generation when we filled in types[] */
+static guint32 known_generation = 0;
+
+/* The MIME database has reloaded, so check that the cache is still valid
+ * before using it again.
+ */
+static gboolean need_database_check = TRUE;
+
+/* MIME_type for each entry in header->types, looked up on demand */
+static MIME_type *types[MAX_TYPES];
+static guint32 type_hashes[MAX_TYPES];	/* Hash of the name we looked up */
+
+/* MIME_type -> index + 1 in header->types */
+static GHashTable *type_indexes = NULL;
+
+/* Static prototypes */
+static gboolean cache_open(void);
+static void cache_reset(void);
+static void forget_types(void);
+static gboolean cache_ready(void);
+static void database_reloaded(void *data);
+static gchar *cache_path(void);
+static void make_key(CacheRecord *key, DirItem *item, struct stat *info);
+static guint32 record_check(CacheRecord *record, guint32 name_hash);
+static gboolean record_valid(CacheRecord *record);
+static void get_type_name(int index, char *name);
+static int n_types(void);
+static gboolean same_file(CacheRecord *a, CacheRecord *b);
+static int type_index(MIME_type *type);
+
+
+/****************************************************************
+ *			EXTERNAL INTERFACE			*
+ ****************************************************************/
+
+void typecache_init(void)
+{
+	option_add_int(&o_type_cache, "type_cache", TRUE);
+
+	type_indexes = g_hash_table_new(NULL, NULL);
+
+	xdg_mime_register_reload_callback(database_reloaded, NULL, NULL);
+}
+
+/* If the cache knows the type of this file, set item->mime_type and the
+ * cached flags and return TRUE. 'info' is the stat() result for the file
+ * (the target, for symlinks).
+ */
+gboolean typecache_lookup(DirItem *item, struct stat *info)
+{
+	CacheRecord key;
+	char name[MAX_TYPE_NAME];
+	guint32 name_hash;
+	guint32 slot;
+	int i;
+
+	if (!cache_ready())
+		return FALSE;
+
+	make_key(&key, item, info);
+	slot = key.name_hash ^ (guint32) key.ino;
+
+	for (i = 0; i < TYPECACHE_PROBE; i++)
+	{
+		CacheRecord *record;
+		int index;
+
+		record = &records[(slot + i) & (TYPECACHE_SLOTS - 1)];
+		if (!same_file(record, &key))
+			continue;
+
+		if (record->type == 0 || record->type > n_types())
+			continue;
+		index = record->type - 1;
+		get_type_name(index, name);
+		name_hash = g_str_hash(name);
+
+		/* Also catches records from before the last reset, ones
+		 * which another copy of the filer was half-way through
+		 * writing, and ones whose type's slot has been reused.
+		 */
+		if (record->check != record_check(record, name_hash))
+			continue;
+
+		if (!types[index] || type_hashes[index] != name_hash)
+		{
+			types[index] = mime_type_lookup(name);
+			if (!types[index])
+				return FALSE;
+			type_hashes[index] = name_hash;
+			g_hash_table_insert(type_indexes, types[index],
+					    GINT_TO_POINTER(index + 1));
+		}
+
+		item->mime_type = types[index];
+		item->flags |= record->flags & CACHED_FLAGS;
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Remember item's mime_type and flags, as worked out for the file 'info' */
+void typecache_store(DirItem *item, struct stat *info)
+{
+	CacheRecord key;
+	CacheRecord *record = NULL;
+	char name[MAX_TYPE_NAME];
+	guint32 slot;
+	int i;
+
+	if (!item->mime_type || !cache_ready())
+		return;
+
+	make_key(&key, item, info);
+	key.type = type_index(item->mime_type);
+	if (!key.type)
+		return;
+	key.flags = item->flags & CACHED_FLAGS;
+	get_type_name(key.type - 1, name);
+	key.check = record_check(&key, g_str_hash(name));
+
+	slot = key.name_hash ^ (guint32) key.ino;
+
+	/* Replace an old record for this file, or use an empty slot, or
+	 * failing that evict whatever is in the first slot.
+	 */
+	for (i = 0; i < TYPECACHE_PROBE; i++)
+	{
+		CacheRecord *this;
+
+		this = &records[(slot + i) & (TYPECACHE_SLOTS - 1)];
+		if (!record_valid(this) || (this->dev == key.dev &&
+					this->ino == key.ino &&
+					this->name_hash == key.name_hash))
+		{
+			record = this;
+			break;
+		}
+	}
+	if (!record)
+		record = &records[slot & (TYPECACHE_SLOTS - 1)];
+
+	*record = key;
+}
+
+/****************************************************************
+ *			INTERNAL FUNCTIONS			*
+ ****************************************************************/
+
+/* Returns TRUE if the cache is open and valid for the current database */
+static gboolean cache_ready(void)
+{
+	if (!o_type_cache.int_value)
+		return FALSE;
+
+	if (!header)
+	{
+		if (tried_open)
+			return FALSE;
+		tried_open = TRUE;
+		if (!cache_open())
+			return FALSE;
+	}
+
+	/* Another copy of the filer may have reset it */
+	if (header->generation != known_generation)
+		forget_types();
+
+	if (need_database_check)
+	{
+		time_t mtime;
+
+		need_database_check = FALSE;
+		mtime = xdg_mime_get_database_mtime();
+		if (header->database_mtime != (gint64) mtime)
+		{
+			cache_reset();
+			header->database_mtime = mtime;
+		}
+	}
+
+	return TRUE;
+}
+
+static void database_reloaded(void *data)
+{
+	need_database_check = TRUE;
+}
+
+/* $XDG_CACHE_HOME/rox.sourceforge.net/ROX-Filer/types, creating the
+ * directories if needed. g_free() the result.
+ */
+static gchar *cache_path(void)
+{
+	const char *base;
+	GString *path;
+
+	base = getenv("XDG_CACHE_HOME");
+
+	if (base && *base)
+		path = g_string_new(base);
+	else
+	{
+		path = g_string_new(home_dir);
+		g_string_append(path, "/.cache");
+	}
+	mkdir(path->str, 0700);
+	g_string_append(path, "/rox.sourceforge.net");
+	mkdir(path->str, 0700);
+	g_string_append(path, "/ROX-Filer");
+	mkdir(path->str, 0700);
+	g_string_append(path, "/types");
+
+	return g_string_free(path, FALSE);
+}
+
+static gboolean cache_open(void)
+{
+	struct stat info;
+	gchar *path;
+	gpointer map;
+	int fd;
+
+	path = cache_path();
+	fd = open(path, O_RDWR | O_CREAT | O_NOCTTY, 0600);
+	if (fd == -1)
+	{
+		g_warning("Can't open type cache '%s': %s",
+			  path, g_strerror(errno));
+		g_free(path);
+		return FALSE;
+	}
+	g_free(path);
+
+	if (fstat(fd, &info) != 0)
+		goto err;
+
+	/* New files are sparse, so this doesn't use much space until
+	 * records are actually written. Anything else in the wrong size
+	 * file will be rejected below.
+	 */
+	if (info.st_size != CACHE_SIZE && ftruncate(fd, CACHE_SIZE) != 0)
+		goto err;
+
+	map = mmap(NULL, CACHE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   fd, 0);
+	if (map == MAP_FAILED)
+		goto err;
+	close(fd);
+
+	header = (CacheHeader *) map;
+	records = (CacheRecord *) (header + 1);
+
+	if (info.st_size != CACHE_SIZE ||
+	    memcmp(header->magic, TYPECACHE_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != TYPECACHE_VERSION ||
+	    header->record_size != sizeof(CacheRecord) ||
+	    header->n_slots != TYPECACHE_SLOTS ||
+	    header->n_types > MAX_TYPES)
+	{
+		memset(header, 0, sizeof(*header));
+		memcpy(header->magic, TYPECACHE_MAGIC, sizeof(header->magic));
+		header->version = TYPECACHE_VERSION;
+		header->record_size = sizeof(CacheRecord);
+		header->n_slots = TYPECACHE_SLOTS;
+		header->generation = (guint32) time(NULL);
+	}
+
+	return TRUE;
+err:
+	g_warning("Can't use type cache: %s", g_strerror(errno));
+	close(fd);
+	return FALSE;
+}
+
+/* Throw away everything in the cache. Existing records stop being valid
+ * without having to touch them.
+ */
+static void cache_reset(void)
+{
+	header->generation++;
+	header->n_types = 0;
+
+	forget_types();
+}
+
+/* Our lookups of the names in header->types are no longer valid */
+static void forget_types(void)
+{
+	memset(types, 0, sizeof(types));
+	g_hash_table_destroy(type_indexes);
+	type_indexes = g_hash_table_new(NULL, NULL);
+
+	known_generation = header->generation;
+}
+
+static void make_key(CacheRecord *key, DirItem *item, struct stat *info)
+{
+	memset(key, 0, sizeof(*key));
+	key->dev = info->st_dev;
+	key->ino = info->st_ino;
+	key->size = info->st_size;
+	key->mtime = info->st_mtime;
+	key->ctime = info->st_ctime;
+	key->name_hash = g_str_hash(item->leafname);
+}
+
+static gboolean record_valid(CacheRecord *record)
+{
+	char name[MAX_TYPE_NAME];
+
+	if (record->type == 0 || record->type > n_types())
+		return FALSE;
+
+	get_type_name(record->type - 1, name);
+
+	return record->check == record_check(record, g_str_hash(name));
+}
+
+/* Copy the name in slot 'index' of the header's table. Another copy of the
+ * filer may be writing it, so make sure it's terminated.
+ */
+static void get_type_name(int index, char *name)
+{
+	memcpy(name, header->types[index], MAX_TYPE_NAME);
+	name[MAX_TYPE_NAME - 1] = '\0';
+}
+
+/* Two copies of the filer adding the last type at once may push
+ * header->n_types past the end of the table.
+ */
+static int n_types(void)
+{
+	return MIN(header->n_types, MAX_TYPES);
+}
+
+static gboolean same_file(CacheRecord *a, CacheRecord *b)
+{
+	return a->ino == b->ino && a->dev == b->dev &&
+	       a->name_hash == b->name_hash && a->size == b->size &&
+	       a->mtime == b->mtime && a->ctime == b->ctime;
+}
+
+/* A simple hash of everything else in the record, and of the name of
+ * its type ('name_hash').
+ */
+static guint32 record_check(CacheRecord *record, guint32 name_hash)
+{
+	const guint32 *word = (const guint32 *) record;
+	guint32 check = 0x524f5821 ^ header->generation;
+	int i;
+
+	for (i = 0; i < G_STRUCT_OFFSET(CacheRecord, check) / 4; i++)
+		check = (check ^ word[i]) * 16777619;
+
+	return (check ^ name_hash) * 16777619;
+}
+
+/* Find the index + 1 of 'type' in the header's table, adding it if it's
+ * not there. Returns 0 if there's no room.
+ */
+static int type_index(MIME_type *type)
+{
+	gchar *name;
+	int i;
+
+	name = g_strconcat(type->media_type, "/", type->subtype, NULL);
+	if (strlen(name) >= MAX_TYPE_NAME)
+	{
+		g_free(name);
+		return 0;
+	}
+
+	/* Check that another copy of the filer hasn't reused the slot */
+	i = GPOINTER_TO_INT(g_hash_table_lookup(type_indexes, type));
+	if (i && strncmp(header->types[i - 1], name, MAX_TYPE_NAME) == 0)
+	{
+		g_free(name);
+		return i;
+	}
+
+	for (i = 0; i < n_types(); i++)
+	{
+		if (strncmp(header->types[i], name, MAX_TYPE_NAME) == 0)
+			break;
+	}
+
+	if (i == n_types())
+	{
+		if (i == MAX_TYPES)
+		{
+			g_free(name);
+			return 0;
+		}
+		strcpy(header->types[i], name);
+		header->n_types++;
+	}
+
+	types[i] = type;
+	type_hashes[i] = g_str_hash(name);
+	g_free(name);
+	g_hash_table_insert(type_indexes, type, GINT_TO_POINTER(i + 1));
+
+	return i + 1;
+}
@@ -0,0 +1,16 @@
+/*
+ * ROX-Filer, filer for the ROX desktop project
+ * By Thomas Leonard, <tal197@users.sourceforge.net>.
+ */
+
+#ifndef _TYPECACHE_H
+#define _TYPECACHE_H
+
+#include <sys/stat.h>
+
+/* Prototypes */
+void typecache_init(void);
+gboolean typecache_lookup(DirItem *item, struct stat *info);
+void typecache_store(DirItem *item, struct stat *info);
+
+#endif /* _TYPECACHE_H */
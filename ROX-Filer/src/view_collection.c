@@ -123,6 +123,7 @@ static void style_set(Collection 	*collection,
 		      ViewCollection	*view_collection);
 static void display_free_colitem(Collection *collection,
 				 CollectionItem *colitem);
+static double colitem_size(Collection *collection, CollectionItem *colitem);
 static void lost_selection(Collection  *collection,
 			   guint        time,
 			   gpointer     user_data);
@@ -139,6 +140,7 @@ static void view_collection_sort(ViewIface *view);
 static void view_collection_style_changed(ViewIface *view, int flags);
 static void view_collection_add_items(ViewIface *view, GPtrArray *items);
 static void view_collection_update_items(ViewIface *view, GPtrArray *items);
+static gboolean in_hash(gpointer data, gpointer hash);
 static void view_collection_delete_if(ViewIface *view,
 			  gboolean (*test)(gpointer item, gpointer data),
 			  gpointer data);
@@ -147,11 +149,14 @@ static void view_collection_select_all(ViewIface *view);
 static void view_collection_clear_selection(ViewIface *view);
 static int view_collection_count_items(ViewIface *view);
 static int view_collection_count_selected(ViewIface *view);
+static double view_collection_selected_size(ViewIface *view);
 static void view_collection_show_cursor(ViewIface *view);
 static void view_collection_get_iter(ViewIface *view,
 				     ViewIter *iter, IterFlags flags);
 static void view_collection_get_iter_at_point(ViewIface *view, ViewIter *iter,
 					      GdkWindow *src, int x, int y);
+static gboolean view_collection_find_item(ViewIface *view, ViewIter *iter,
+					  DirItem *item);
 static void view_collection_cursor_to_iter(ViewIface *view, ViewIter *iter);
 static void view_collection_set_selected(ViewIface *view,
 					 ViewIter *iter,
@@ -286,6 +291,7 @@ static void view_collection_init(GTypeInstance *object, gpointer gclass)
 			GTK_RESIZE_IMMEDIATE);
 
 	view_collection->collection->free_item = display_free_colitem;
+	view_collection->collection->item_size = colitem_size;
 	view_collection->collection->draw_item = draw_item;
 	view_collection->collection->test_point = test_point;
 	view_collection->collection->cb_user_data = view_collection;
@@ -331,6 +337,12 @@ static void draw_item(GtkWidget *widget,
 
 	g_return_if_fail(view != NULL);
 
+	/* Find out what it really is, now that someone's looking */
+	if (item->flags & ITEM_FLAG_NEED_SNIFF)
+		dir_queue_sniff(filer_window->directory, item);
+
+	display_view_layouts(filer_window, item, view);
+
 	if (selected)
 		selection_state = filer_window->selection_state;
 	else
@@ -388,7 +400,7 @@ static void fill_template(GdkRectangle *area, CollectionItem *colitem,
 	DisplayStyle	style = view_collection->filer_window->display_style;
 	ViewData 	*view = (ViewData *) colitem->view_data;
 
-	if (view->details)
+	if (view->has_details)
 	{
 		template->details.width = view->details_width;
 		template->details.height = view->details_height;
@@ -625,7 +637,8 @@ static gboolean test_point(Collection *collection,
 
 	return INSIDE(point_x, point_y, template.leafname) ||
 	       INSIDE(point_x, point_y, template.icon) ||
-	       (view->details && INSIDE(point_x, point_y, template.details));
+	       (view->has_details &&
+		INSIDE(point_x, point_y, template.details));
 }
 
 /* 'box' renders a background box if the string is also selected */
@@ -696,9 +709,11 @@ static void view_collection_iface_init(gpointer giface, gpointer iface_data)
 	iface->clear_selection = view_collection_clear_selection;
 	iface->count_items = view_collection_count_items;
 	iface->count_selected = view_collection_count_selected;
+	iface->selected_size = view_collection_selected_size;
 	iface->show_cursor = view_collection_show_cursor;
 	iface->get_iter = view_collection_get_iter;
 	iface->get_iter_at_point = view_collection_get_iter_at_point;
+	iface->find_item = view_collection_find_item;
 	iface->cursor_to_iter = view_collection_cursor_to_iter;
 	iface->set_selected = view_collection_set_selected;
 	iface->get_selected = view_collection_get_selected;
@@ -833,18 +848,12 @@ static void display_free_colitem(Collection *collection,
 	if (!view)
 		return;
 
-	if (view->layout)
-	{
-		g_object_unref(G_OBJECT(view->layout));
-		view->layout = NULL;
-	}
-	if (view->details)
-		g_object_unref(G_OBJECT(view->details));
+	display_free_viewdata(view);
+}
 
-	if (view->image)
-		g_object_unref(view->image);
-	
-	g_free(view);
+static double colitem_size(Collection *collection, CollectionItem *colitem)
+{
+	return di_total_size((DirItem *) colitem->data);
 }
 
 static void add_item(ViewCollection *view_collection, DirItem *item)
@@ -961,6 +970,9 @@ static void update_item(ViewCollection *view_collection, int i)
 			(DirItem *) colitem->data,
 			(ViewData *) colitem->view_data,
 			FALSE);
+
+	/* The item's size may have changed, if it's selected */
+	collection_update_item_size(collection, i);
 	
 	calc_size(filer_window, colitem, &w, &h); 
 	if (w > old_w || h > old_h)
@@ -1043,13 +1055,30 @@ static SortFn sort_fn(FilerWindow *fw)
 	return NULL;
 }
 
+static SortKeyFunc sort_keys_fn(FilerWindow *fw)
+{
+	switch (fw->sort_type)
+	{
+		case SORT_NAME: return sort_keys_by_name;
+		case SORT_TYPE: return sort_keys_by_type;
+		case SORT_DATE: return sort_keys_by_date;
+		case SORT_SIZE: return sort_keys_by_size;
+		case SORT_OWNER: return sort_keys_by_owner;
+		case SORT_GROUP: return sort_keys_by_group;
+		default:
+			g_assert_not_reached();
+	}
+
+	return NULL;
+}
+
 static void view_collection_sort(ViewIface *view)
 {
 	ViewCollection	*view_collection = VIEW_COLLECTION(view);
 	FilerWindow	*filer_window = view_collection->filer_window;
 
 	collection_qsort(view_collection->collection, sort_fn(filer_window),
-			filer_window->sort_order);
+			sort_keys_fn(filer_window), filer_window->sort_order);
 }
 
 static void view_collection_add_items(ViewIface *view, GPtrArray *items)
@@ -1070,8 +1099,14 @@ static void view_collection_add_items(ViewIface *view, GPtrArray *items)
 		add_item(view_collection, item);
 	}
 
-	if (old_num != collection->number_of_items)
-		view_collection_sort(view);
+	collection_merge_new(collection, old_num, sort_fn(filer_window),
+			     sort_keys_fn(filer_window),
+			     filer_window->sort_order);
+}
+
+static gboolean in_hash(gpointer data, gpointer hash)
+{
+	return g_hash_table_lookup((GHashTable *) hash, data) != NULL;
 }
 
 static void view_collection_update_items(ViewIface *view, GPtrArray *items)
@@ -1079,15 +1114,24 @@ static void view_collection_update_items(ViewIface *view, GPtrArray *items)
 	ViewCollection	*view_collection = VIEW_COLLECTION(view);
 	Collection	*collection = view_collection->collection;
 	FilerWindow	*filer_window = view_collection->filer_window;
-	int		i;
+	GHashTable	*changed;
+	int		i, first;
 
 	g_return_if_fail(items->len > 0);
-	
-	/* The item data has already been modified, so this gives the
-	 * final sort order...
+
+	/* The item data has already been modified, so the changed items may
+	 * now be out of place. Pull them out and merge them back in, leaving
+	 * the rest of the (still sorted) collection alone.
 	 */
-	collection_qsort(collection, sort_fn(filer_window),
-			 filer_window->sort_order);
+	changed = g_hash_table_new(NULL, NULL);
+	for (i = 0; i < items->len; i++)
+		g_hash_table_insert(changed, items->pdata[i], items->pdata[i]);
+	first = collection_extract_items(collection, in_hash, changed);
+	g_hash_table_destroy(changed);
+
+	collection_merge_new(collection, first, sort_fn(filer_window),
+			     sort_keys_fn(filer_window),
+			     filer_window->sort_order);
 
 	for (i = 0; i < items->len; i++)
 	{
@@ -1159,6 +1203,14 @@ static int view_collection_count_selected(ViewIface *view)
 	return collection->number_selected;
 }
 
+static double view_collection_selected_size(ViewIface *view)
+{
+	ViewCollection	*view_collection = VIEW_COLLECTION(view);
+	Collection	*collection = view_collection->collection;
+	
+	return collection->selected_size;
+}
+
 static void view_collection_show_cursor(ViewIface *view)
 {
 	ViewCollection	*view_collection = VIEW_COLLECTION(view);
@@ -1359,6 +1411,21 @@ static void view_collection_get_iter_at_point(ViewIface *view, ViewIter *iter,
 	make_item_iter(view_collection, iter, i);
 }
 
+static gboolean view_collection_find_item(ViewIface *view, ViewIter *iter,
+					  DirItem *item)
+{
+	ViewCollection *view_collection = VIEW_COLLECTION(view);
+	FilerWindow *filer_window = view_collection->filer_window;
+	int i;
+
+	i = collection_find_item(view_collection->collection, item,
+				 sort_fn(filer_window),
+				 filer_window->sort_order);
+	make_item_iter(view_collection, iter, i);
+
+	return i >= 0;
+}
+
 static void view_collection_cursor_to_iter(ViewIface *view, ViewIter *iter)
 {
 	ViewCollection	*view_collection = VIEW_COLLECTION(view);
@@ -21,6 +21,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
 
@@ -81,11 +83,14 @@ static void view_details_select_all(ViewIface *view);
 static void view_details_clear_selection(ViewIface *view);
 static int view_details_count_items(ViewIface *view);
 static int view_details_count_selected(ViewIface *view);
+static double view_details_selected_size(ViewIface *view);
 static void view_details_show_cursor(ViewIface *view);
 static void view_details_get_iter(ViewIface *view,
 				     ViewIter *iter, IterFlags flags);
 static void view_details_get_iter_at_point(ViewIface *view, ViewIter *iter,
 					   GdkWindow *src, int x, int y);
+static gboolean view_details_find_item(ViewIface *view, ViewIter *iter,
+				       DirItem *item);
 static void view_details_cursor_to_iter(ViewIface *view, ViewIter *iter);
 static void view_details_set_selected(ViewIface *view,
 					 ViewIter *iter,
@@ -986,6 +991,9 @@ static void selection_changed(GtkTreeSelection *selection,
 {
 	ViewDetails *view_details = VIEW_DETAILS(user_data);
 
+	view_details->n_selected = -1;
+	view_details->selected_size = -1;
+
 	filer_selection_changed(view_details->filer_window,
 			gtk_get_current_event_time());
 }
@@ -1030,6 +1038,8 @@ static void view_details_init(GTypeInstance *object, gpointer gclass)
 	view_details->desired_size.width = -1;
 	view_details->desired_size.height = -1;
 	view_details->can_change_selection = 0;
+	view_details->n_selected = -1;
+	view_details->selected_size = -1;
 	view_details->lasso_box = FALSE;
 
 	view_details->selection = gtk_tree_view_get_selection(treeview);
@@ -1040,6 +1050,7 @@ static void view_details_init(GTypeInstance *object, gpointer gclass)
 
 	/* Sorting */
 	view_details->sort_fn = NULL;
+	view_details->sort_keys = NULL;
 	sortable_list = GTK_TREE_SORTABLE(object);
 
 	gtk_tree_view_set_model(treeview, GTK_TREE_MODEL(view_details));
@@ -1099,9 +1110,11 @@ static void view_details_iface_init(gpointer giface, gpointer iface_data)
 	iface->clear_selection = view_details_clear_selection;
 	iface->count_items = view_details_count_items;
 	iface->count_selected = view_details_count_selected;
+	iface->selected_size = view_details_selected_size;
 	iface->show_cursor = view_details_show_cursor;
 	iface->get_iter = view_details_get_iter;
 	iface->get_iter_at_point = view_details_get_iter_at_point;
+	iface->find_item = view_details_find_item;
 	iface->cursor_to_iter = view_details_cursor_to_iter;
 	iface->set_selected = view_details_set_selected;
 	iface->get_selected = view_details_get_selected;
@@ -1165,35 +1178,90 @@ static gint wrap_sort(gconstpointer a, gconstpointer b,
 		return -view_details->sort_fn(ia->item, ib->item);
 }
 
-static void resort(ViewDetails *view_details)
+static void set_sort_fn(ViewDetails *view_details)
 {
-	ViewItem **items = (ViewItem **) view_details->items->pdata;
-	gint i, len = view_details->items->len;
-	guint *new_order;
-	GtkTreePath *path;
-	int wink_item = view_details->wink_item;
-
-	if (!len)
-		return;
-
-	for (i = len - 1; i >= 0; i--)
-		items[i]->old_pos = i;
-
 	switch (view_details->filer_window->sort_type)
 	{
-		case SORT_NAME: view_details->sort_fn = sort_by_name; break;
-		case SORT_TYPE: view_details->sort_fn = sort_by_type; break;
-		case SORT_DATE: view_details->sort_fn = sort_by_date; break;
-		case SORT_SIZE: view_details->sort_fn = sort_by_size; break;
-		case SORT_OWNER: view_details->sort_fn = sort_by_owner; break;
-		case SORT_GROUP: view_details->sort_fn = sort_by_group; break;
+		case SORT_NAME:
+			view_details->sort_fn = sort_by_name;
+			view_details->sort_keys = sort_keys_by_name;
+			break;
+		case SORT_TYPE:
+			view_details->sort_fn = sort_by_type;
+			view_details->sort_keys = sort_keys_by_type;
+			break;
+		case SORT_DATE:
+			view_details->sort_fn = sort_by_date;
+			view_details->sort_keys = sort_keys_by_date;
+			break;
+		case SORT_SIZE:
+			view_details->sort_fn = sort_by_size;
+			view_details->sort_keys = sort_keys_by_size;
+			break;
+		case SORT_OWNER:
+			view_details->sort_fn = sort_by_owner;
+			view_details->sort_keys = sort_keys_by_owner;
+			break;
+		case SORT_GROUP:
+			view_details->sort_fn = sort_by_group;
+			view_details->sort_keys = sort_keys_by_group;
+			break;
 		default:
 			g_assert_not_reached();
 	}
-	
-	g_ptr_array_sort_with_data(view_details->items,
-				   (GCompareDataFunc) wrap_sort,
-				   view_details);
+}
+
+/* Sort the 'n' ViewItems at 'items' with the sortkey engine.
+ * Returns FALSE if they were already in order.
+ */
+static gboolean sort_view_items(ViewDetails *view_details,
+				ViewItem **items, int n)
+{
+	SortKey	*keys;
+	ViewItem **old;
+	int	i;
+
+	keys = g_new(SortKey, n);
+	for (i = 0; i < n; i++)
+		keys[i].data = items[i]->item;
+
+	if (!sortkey_sort(keys, n, view_details->sort_fn,
+			  view_details->sort_keys,
+			  view_details->filer_window->sort_order))
+	{
+		g_free(keys);
+		return FALSE;
+	}
+
+	old = g_new(ViewItem *, n);
+	memcpy(old, items, n * sizeof(ViewItem *));
+	for (i = 0; i < n; i++)
+		items[i] = old[keys[i].index];
+
+	g_free(old);
+	g_free(keys);
+
+	return TRUE;
+}
+
+/* Record each item's position, ready for emit_reordered() */
+static void save_positions(ViewDetails *view_details)
+{
+	ViewItem **items = (ViewItem **) view_details->items->pdata;
+	gint i;
+
+	for (i = view_details->items->len - 1; i >= 0; i--)
+		items[i]->old_pos = i;
+}
+
+/* Tell the tree view where everything went since save_positions() */
+static void emit_reordered(ViewDetails *view_details)
+{
+	ViewItem **items = (ViewItem **) view_details->items->pdata;
+	gint i, len = view_details->items->len;
+	guint *new_order;
+	GtkTreePath *path;
+	int wink_item = view_details->wink_item;
 
 	new_order = g_new(guint, len);
 	for (i = len - 1; i >= 0; i--)
@@ -1212,6 +1280,72 @@ static void resort(ViewDetails *view_details)
 	g_free(new_order);
 }
 
+static void resort(ViewDetails *view_details)
+{
+	if (!view_details->items->len)
+		return;
+
+	save_positions(view_details);
+	set_sort_fn(view_details);
+
+	if (sort_view_items(view_details,
+			    (ViewItem **) view_details->items->pdata,
+			    view_details->items->len))
+		emit_reordered(view_details);
+}
+
+/* Items from 'first' onwards are in no particular order, but the ones before
+ * them are sorted. Sort just the tail and merge it in, so that the number of
+ * comparisons depends on the size of the tail, not the whole list.
+ * Returns FALSE if there was nothing to do.
+ */
+static gboolean merge_tail(ViewDetails *view_details, int first)
+{
+	ViewItem **items = (ViewItem **) view_details->items->pdata;
+	ViewItem **new;
+	int	n_new = view_details->items->len - first;
+	int	old_end = first;
+	int	k;
+
+	if (n_new == 0)
+		return FALSE;
+
+	set_sort_fn(view_details);
+
+	new = g_new(ViewItem *, n_new);
+	memcpy(new, items + first, n_new * sizeof(ViewItem *));
+	sort_view_items(view_details, new, n_new);
+
+	/* Working down from the end, each new item goes after any old items
+	 * which compare equal to it.
+	 */
+	for (k = n_new - 1; k >= 0 && old_end > 0; k--)
+	{
+		int	lower = 0, upper = old_end;
+
+		while (lower < upper)
+		{
+			int	i = (lower + upper) >> 1;
+
+			if (wrap_sort(&items[i], &new[k], view_details) > 0)
+				upper = i;
+			else
+				lower = i + 1;
+		}
+
+		memmove(items + lower + k + 1, items + lower,
+			(old_end - lower) * sizeof(ViewItem *));
+		items[lower + k] = new[k];
+		old_end = lower;
+	}
+
+	/* Anything left goes at the start */
+	memcpy(items, new, (k + 1) * sizeof(ViewItem *));
+	g_free(new);
+
+	return TRUE;
+}
+
 static void view_details_sort(ViewIface *view)
 {
 	resort((ViewDetails *) view);
@@ -1225,6 +1359,7 @@ static void view_details_add_items(ViewIface *view, GPtrArray *new_items)
 	GPtrArray *items = view_details->items;
 	GtkTreeIter iter;
 	int i;
+	int old_len = items->len;
 	GtkTreePath *path;
 	GtkTreeModel *model = (GtkTreeModel *) view;
 
@@ -1266,7 +1401,9 @@ static void view_details_add_items(ViewIface *view, GPtrArray *new_items)
 
 	gtk_tree_path_free(path);
 
-	resort(view_details);
+	save_positions(view_details);
+	if (merge_tail(view_details, old_len))
+		emit_reordered(view_details);
 }
 
 /* Find an item in the sorted array.
@@ -1314,13 +1451,43 @@ static void view_details_update_items(ViewIface *view, GPtrArray *items)
 	FilerWindow	*filer_window = view_details->filer_window;
 	int		i;
 	GtkTreeModel	*model = (GtkTreeModel *) view_details;
+	GHashTable	*changed;
+	GPtrArray	*moved;
+	ViewItem	**vitems;
+	int		in, out;
 
 	g_return_if_fail(items->len > 0);
 	
-	/* The item data has already been modified, so this gives the
-	 * final sort order...
+	/* The item data has already been modified, so the changed items may
+	 * now be out of place. Move them to the end (keeping the order of the
+	 * rest) and merge them back in.
 	 */
-	resort(view_details);
+	changed = g_hash_table_new(NULL, NULL);
+	for (i = 0; i < items->len; i++)
+		g_hash_table_insert(changed, items->pdata[i], items->pdata[i]);
+
+	save_positions(view_details);
+
+	vitems = (ViewItem **) view_details->items->pdata;
+	moved = g_ptr_array_new();
+	out = 0;
+	for (in = 0; in < view_details->items->len; in++)
+	{
+		ViewItem *vitem = vitems[in];
+
+		if (g_hash_table_lookup(changed, vitem->item))
+			g_ptr_array_add(moved, vitem);
+		else
+			vitems[out++] = vitem;
+	}
+	if (moved->len)
+		memcpy(vitems + out, moved->pdata,
+			moved->len * sizeof(ViewItem *));
+	g_ptr_array_free(moved, TRUE);
+	g_hash_table_destroy(changed);
+
+	if (merge_tail(view_details, out))
+		emit_reordered(view_details);
 
 	for (i = 0; i < items->len; i++)
 	{
@@ -1351,6 +1518,9 @@ static void view_details_update_items(ViewIface *view, GPtrArray *items)
 			gtk_tree_model_row_changed(model, path, &iter);
 		}
 	}
+
+	/* The sizes of some selected items may have changed */
+	view_details->selected_size = -1;
 }
 
 static void view_details_delete_if(ViewIface *view,
@@ -1385,6 +1555,10 @@ static void view_details_delete_if(ViewIface *view,
 	}
 
 	gtk_tree_path_free(path);
+
+	/* Older GTKs don't send "changed" for deleted selected rows */
+	((ViewDetails *) view)->n_selected = -1;
+	((ViewDetails *) view)->selected_size = -1;
 }
 
 static void view_details_clear(ViewIface *view)
@@ -1401,6 +1575,9 @@ static void view_details_clear(ViewIface *view)
 
 	g_ptr_array_set_size(items, 0);
 	gtk_tree_path_free(path);
+
+	((ViewDetails *) view)->n_selected = -1;
+	((ViewDetails *) view)->selected_size = -1;
 }
 
 static void view_details_select_all(ViewIface *view)
@@ -1441,15 +1618,38 @@ static int view_details_count_selected(ViewIface *view)
 {
 	ViewDetails *view_details = (ViewDetails *) view;
 
+	/* Counting walks the whole tree, so only do it once per change */
+	if (view_details->n_selected >= 0)
+		return view_details->n_selected;
+
 #if GTK_MINOR_VERSION >= 2
-	return gtk_tree_selection_count_selected_rows(view_details->selection);
+	view_details->n_selected =
+		gtk_tree_selection_count_selected_rows(view_details->selection);
 #else
-	int count = 0;
+	view_details->n_selected = 0;
 	
 	gtk_tree_selection_selected_foreach(view_details->selection,
-					    view_details_count_inc, &count);
-	return count;
+					    view_details_count_inc,
+					    &view_details->n_selected);
 #endif
+	return view_details->n_selected;
+}
+
+static double view_details_selected_size(ViewIface *view)
+{
+	ViewDetails *view_details = (ViewDetails *) view;
+	ViewIter    iter;
+	DirItem	    *item;
+
+	if (view_details->selected_size >= 0)
+		return view_details->selected_size;
+
+	view_details->selected_size = 0;
+	make_iter(view_details, &iter, VIEW_ITER_SELECTED);
+	while ((item = iter.next(&iter)))
+		view_details->selected_size += di_total_size(item);
+
+	return view_details->selected_size;
 }
 
 static void view_details_show_cursor(ViewIface *view)
@@ -1487,6 +1687,18 @@ static void view_details_get_iter_at_point(ViewIface *view, ViewIter *iter,
 	make_item_iter(view_details, iter, i);
 }
 
+static gboolean view_details_find_item(ViewIface *view, ViewIter *iter,
+				       DirItem *item)
+{
+	ViewDetails *view_details = (ViewDetails *) view;
+	int i;
+
+	i = details_find_item(view_details, item);
+	make_item_iter(view_details, iter, i);
+
+	return i >= 0;
+}
+
 static void view_details_cursor_to_iter(ViewIface *view, ViewIter *iter)
 {
 	GtkTreePath *path;
@@ -8,6 +8,8 @@
 
 #include <gtk/gtk.h>
 
+#include "sortkey.h"
+
 typedef struct _ViewDetailsClass ViewDetailsClass;
 
 typedef struct _ViewItem ViewItem;
@@ -30,6 +32,7 @@ struct _ViewDetails {
 	GPtrArray   *items;		/* ViewItem */
 	
 	int	    (*sort_fn)(const void *, const void *);
+	SortKeyFunc sort_keys;		/* Matches sort_fn */
 
 	int	    cursor_base;	/* Cursor when minibuffer opened */
 
@@ -38,6 +41,8 @@ struct _ViewDetails {
 	int	    wink_step;
 
 	int	    can_change_selection;
+	int	    n_selected;		/* Cached count, or -1 */
+	double	    selected_size;	/* Cached total, or -1 */
 
 	GtkRequisition desired_size;
 
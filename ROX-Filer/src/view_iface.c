@@ -210,6 +210,14 @@ int view_count_selected(ViewIface *obj)
 	return VIEW_IFACE_GET_CLASS(obj)->count_selected(obj);
 }
 
+/* Return the total size of the selected items (see di_total_size()) */
+double view_selected_size(ViewIface *obj)
+{
+	g_return_val_if_fail(VIEW_IS_IFACE(obj), 0);
+
+	return VIEW_IFACE_GET_CLASS(obj)->selected_size(obj);
+}
+
 void view_show_cursor(ViewIface *obj)
 {
 	g_return_if_fail(VIEW_IS_IFACE(obj));
@@ -383,6 +391,17 @@ void view_get_iter_at_point(ViewIface *obj, ViewIter *iter,
 	VIEW_IFACE_GET_CLASS(obj)->get_iter_at_point(obj, iter, window, x, y);
 }
 
+/* Set the iterator to return 'item' on the next peek(), using a binary
+ * search of the sorted view. Returns FALSE if the item isn't shown.
+ */
+gboolean view_find_item(ViewIface *obj, ViewIter *iter, DirItem *item)
+{
+	g_return_val_if_fail(VIEW_IS_IFACE(obj), FALSE);
+	g_return_val_if_fail(item != NULL, FALSE);
+
+	return VIEW_IFACE_GET_CLASS(obj)->find_item(obj, iter, item);
+}
+
 /* Begin a drag to select a group of icons */
 void view_start_lasso_box(ViewIface *obj, GdkEventButton *event)
 {
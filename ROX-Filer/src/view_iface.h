@@ -67,11 +67,13 @@ struct _ViewIfaceClass {
 	void (*clear_selection)(ViewIface *obj);
 	int (*count_items)(ViewIface *obj);
 	int (*count_selected)(ViewIface *obj);
+	double (*selected_size)(ViewIface *obj);
 	void (*show_cursor)(ViewIface *obj);
 
 	void (*get_iter)(ViewIface *obj, ViewIter *iter, IterFlags flags);
 	void (*get_iter_at_point)(ViewIface *obj, ViewIter *iter,
 				  GdkWindow *src, int x, int y);
+	gboolean (*find_item)(ViewIface *obj, ViewIter *iter, DirItem *item);
 	void (*cursor_to_iter)(ViewIface *obj, ViewIter *iter);
 
 	void (*set_selected)(ViewIface *obj, ViewIter *iter, gboolean selected);
@@ -119,11 +121,13 @@ void view_select_all(ViewIface *obj);
 void view_clear_selection(ViewIface *obj);
 int view_count_items(ViewIface *obj);
 int view_count_selected(ViewIface *obj);
+double view_selected_size(ViewIface *obj);
 void view_show_cursor(ViewIface *obj);
 
 void view_get_iter(ViewIface *obj, ViewIter *iter, IterFlags flags);
 void view_get_iter_at_point(ViewIface *obj, ViewIter *iter,
 			    GdkWindow *src, int x, int y);
+gboolean view_find_item(ViewIface *obj, ViewIter *iter, DirItem *item);
 void view_get_cursor(ViewIface *obj, ViewIter *iter);
 void view_cursor_to_iter(ViewIface *obj, ViewIter *iter);
 
@@ -42,6 +42,8 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <assert.h>
 
 /* ROX: */
@@ -463,6 +465,110 @@ xdg_mime_init (void)
     }
 }
 
+/* ROX: Each thread keeps one buffer for sniffing file contents, grown as
+ * needed, rather than allocating a new one for every file.
+ */
+typedef struct _SniffBuffer SniffBuffer;
+
+struct _SniffBuffer
+{
+  unsigned char *data;
+  int size;
+};
+
+static GStaticPrivate sniff_buffer_key = G_STATIC_PRIVATE_INIT;
+
+static void
+sniff_buffer_free (gpointer data)
+{
+  SniffBuffer *buffer = (SniffBuffer *) data;
+
+  g_free (buffer->data);
+  g_free (buffer);
+}
+
+/* ROX: Read up to max_extent bytes from the start of file_name into this
+ * thread's sniff buffer. 'statbuf' is the caller's existing stat() of the
+ * file; if NULL, the open file is fstat()ed instead. Returns NULL if the
+ * file isn't a regular file or can't be read. The result is valid until
+ * the next call from the same thread.
+ */
+const unsigned char *
+_xdg_mime_read_file_head (const char  *file_name,
+			  struct stat *statbuf,
+			  int          max_extent,
+			  int         *bytes_read)
+{
+  SniffBuffer *buffer;
+  struct stat buf;
+  ssize_t got = 0;
+  int total;
+  int fd;
+
+  if (statbuf && !S_ISREG (statbuf->st_mode))
+    return NULL;
+
+  if (max_extent <= 0)
+    {
+      *bytes_read = 0;
+      return (const unsigned char *) "";
+    }
+
+  /* O_NONBLOCK so that we don't hang if there's a FIFO here and the
+   * caller didn't give us the file's type. It has no effect on reads
+   * from regular files.
+   */
+  fd = open (file_name, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+  if (fd == -1)
+    return NULL;
+
+  if (!statbuf)
+    {
+      if (fstat (fd, &buf) != 0 || !S_ISREG (buf.st_mode))
+	{
+	  close (fd);
+	  return NULL;
+	}
+      statbuf = &buf;
+    }
+
+  buffer = g_static_private_get (&sniff_buffer_key);
+  if (!buffer)
+    {
+      buffer = g_new0 (SniffBuffer, 1);
+      g_static_private_set (&sniff_buffer_key, buffer, sniff_buffer_free);
+    }
+  if (buffer->size < max_extent)
+    {
+      g_free (buffer->data);
+      buffer->data = g_malloc (max_extent);
+      buffer->size = max_extent;
+    }
+
+  /* Don't trust st_size: files in /proc and /sys claim to be empty, and
+   * the file may have grown since it was stat()ed. Like fread(), keep
+   * going until we have max_extent bytes or reach the end.
+   */
+  total = 0;
+  while (total < max_extent)
+    {
+      got = pread (fd, buffer->data + total, max_extent - total, total);
+      if (got == -1 && errno == EINTR)
+	continue;
+      if (got <= 0)
+	break;
+      total += got;
+    }
+
+  close (fd);
+
+  if (got < 0)
+    return NULL;
+
+  *bytes_read = total;
+  return buffer->data;
+}
+
 const char *
 xdg_mime_get_mime_type_for_data (const void *data,
 				 size_t      len)
@@ -489,11 +595,9 @@ xdg_mime_get_mime_type_for_file (const char  *file_name,
   const char *mime_type;
   /* Used to detect whether multiple MIME types match file_name */
   const char *mime_types[2];
-  FILE *file;
-  unsigned char *data;
+  const unsigned char *data;
   int max_extent;
   int bytes_read;
-  struct stat buf;
   const char *base_name;
   int n;
 
@@ -513,46 +617,18 @@ xdg_mime_get_mime_type_for_file (const char  *file_name,
   if (n == 1)
     return mime_types[0];
 
-  if (!statbuf)
-    {
-      if (stat (file_name, &buf) != 0)
-	return XDG_MIME_TYPE_UNKNOWN;
-
-      statbuf = &buf;
-    }
-
-  if (!S_ISREG (statbuf->st_mode))
-    return XDG_MIME_TYPE_UNKNOWN;
-
   /* FIXME: Need to make sure that max_extent isn't totally broken.  This could
    * be large and need getting from a stream instead of just reading it all
    * in. */
   max_extent = _xdg_mime_magic_get_buffer_extents (global_magic);
-  data = malloc (max_extent);
+  data = _xdg_mime_read_file_head (file_name, statbuf, max_extent,
+				   &bytes_read);
   if (data == NULL)
     return XDG_MIME_TYPE_UNKNOWN;
-        
-  file = fopen (file_name, "r");
-  if (file == NULL)
-    {
-      free (data);
-      return XDG_MIME_TYPE_UNKNOWN;
-    }
-
-  bytes_read = fread (data, 1, max_extent, file);
-  if (ferror (file))
-    {
-      free (data);
-      fclose (file);
-      return XDG_MIME_TYPE_UNKNOWN;
-    }
 
   mime_type = _xdg_mime_magic_lookup_data (global_magic, data, bytes_read,
 					   mime_types, n);
 
-  free (data);
-  fclose (file);
-
   if (mime_type)
     return mime_type;
 
@@ -575,6 +651,33 @@ xdg_mime_get_mime_type_from_file_name (const char *file_name)
     return XDG_MIME_TYPE_UNKNOWN;
 }
 
+/* ROX: Finds up to n_mime_types types matching the leafname of file_name
+ * using the glob rules only. Returns the number of matches; if this isn't
+ * exactly one then the contents would be needed to decide.
+ */
+int
+xdg_mime_get_mime_types_from_file_name (const char *file_name,
+					const char *mime_types[],
+					int         n_mime_types)
+{
+  const char *base_name;
+
+  if (file_name == NULL || ! _xdg_utf8_validate (file_name))
+    return 0;
+
+  xdg_mime_init ();
+
+  base_name = _xdg_get_base_name (file_name);
+
+  if (_xdg_mime_caches)
+    return _xdg_mime_cache_get_mime_types_from_file_name (base_name,
+							  mime_types,
+							  n_mime_types);
+
+  return _xdg_glob_hash_lookup_file_name (global_hash, base_name,
+					  mime_types, n_mime_types);
+}
+
 int
 xdg_mime_is_valid_mime_type (const char *mime_type)
 {
@@ -634,6 +737,27 @@ xdg_mime_shutdown (void)
   need_reread = TRUE;
 }
 
+/* ROX: Returns the modification time of the newest database file in use.
+ * Anyone keeping the results of lookups between runs can compare this to
+ * see whether they are still valid.
+ */
+time_t
+xdg_mime_get_database_mtime (void)
+{
+  XdgDirTimeList *list;
+  time_t newest = 0;
+
+  xdg_mime_init ();
+
+  for (list = dir_time_list; list; list = list->next)
+    {
+      if (list->mtime > newest)
+	newest = list->mtime;
+    }
+
+  return newest;
+}
+
 int
 xdg_mime_get_max_buffer_extents (void)
 {
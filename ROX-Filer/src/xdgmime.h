@@ -54,6 +54,7 @@ typedef void (*XdgMimeDestroy)  (void *user_data);
 #define xdg_mime_get_mime_type_for_data       XDG_ENTRY(mime_get_mime_type_for_data)
 #define xdg_mime_get_mime_type_for_file       XDG_ENTRY(mime_get_mime_type_for_file)
 #define xdg_mime_get_mime_type_from_file_name XDG_ENTRY(mime_get_mime_type_from_file_name)
+#define xdg_mime_get_mime_types_from_file_name XDG_ENTRY(mime_get_mime_types_from_file_name)
 #define xdg_mime_is_valid_mime_type           XDG_ENTRY(mime_is_valid_mime_type)
 #define xdg_mime_mime_type_equal              XDG_ENTRY(mime_mime_type_equal)
 #define xdg_mime_media_type_equal             XDG_ENTRY(mime_media_type_equal)
@@ -62,6 +63,7 @@ typedef void (*XdgMimeDestroy)  (void *user_data);
 #define xdg_mime_list_mime_parents            XDG_ENTRY(mime_list_mime_parents)
 #define xdg_mime_unalias_mime_type            XDG_ENTRY(mime_unalias_mime_type)
 #define xdg_mime_get_max_buffer_extents       XDG_ENTRY(mime_get_max_buffer_extents)
+#define xdg_mime_get_database_mtime           XDG_ENTRY(mime_get_database_mtime)
 #define xdg_mime_shutdown                     XDG_ENTRY(mime_shutdown)
 #define xdg_mime_dump                         XDG_ENTRY(mime_dump)
 #define xdg_mime_register_reload_callback     XDG_ENTRY(mime_register_reload_callback)
@@ -85,6 +87,9 @@ const char  *xdg_mime_get_mime_type_for_data       (const void *data,
 const char  *xdg_mime_get_mime_type_for_file       (const char *file_name,
                                                     struct stat *statbuf);
 const char  *xdg_mime_get_mime_type_from_file_name (const char *file_name);
+int          xdg_mime_get_mime_types_from_file_name (const char *file_name,
+						     const char *mime_types[],
+						     int         n_mime_types);
 int          xdg_mime_is_valid_mime_type           (const char *mime_type);
 int          xdg_mime_mime_type_equal              (const char *mime_a,
 						    const char *mime_b);
@@ -101,6 +106,7 @@ const char **xdg_mime_get_mime_parents		   (const char *mime);
 char **      xdg_mime_list_mime_parents		   (const char *mime);
 const char  *xdg_mime_unalias_mime_type		   (const char *mime);
 int          xdg_mime_get_max_buffer_extents       (void);
+time_t       xdg_mime_get_database_mtime           (void); /* ROX: */
 void         xdg_mime_shutdown                     (void);
 void         xdg_mime_dump                         (void);
 int          xdg_mime_register_reload_callback     (XdgMimeCallback  callback,
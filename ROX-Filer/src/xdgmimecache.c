@@ -674,11 +674,9 @@ _xdg_mime_cache_get_mime_type_for_file (const char  *file_name,
 {
   const char *mime_type;
   const char *mime_types[2];
-  FILE *file;
-  unsigned char *data;
+  const unsigned char *data;
   int max_extent;
   int bytes_read;
-  struct stat buf;
   const char *base_name;
   int n;
 
@@ -694,46 +692,18 @@ _xdg_mime_cache_get_mime_type_for_file (const char  *file_name,
   if (n == 1)
     return mime_types[0];
 
-  if (!statbuf)
-    {
-      if (stat (file_name, &buf) != 0)
-	return XDG_MIME_TYPE_UNKNOWN;
-
-      statbuf = &buf;
-    }
-
-  if (!S_ISREG (statbuf->st_mode))
-    return XDG_MIME_TYPE_UNKNOWN;
-
   /* FIXME: Need to make sure that max_extent isn't totally broken.  This could
    * be large and need getting from a stream instead of just reading it all
    * in. */
   max_extent = _xdg_mime_cache_get_max_buffer_extents ();
-  data = malloc (max_extent);
+  data = _xdg_mime_read_file_head (file_name, statbuf, max_extent,
+				   &bytes_read);
   if (data == NULL)
     return XDG_MIME_TYPE_UNKNOWN;
-        
-  file = fopen (file_name, "r");
-  if (file == NULL)
-    {
-      free (data);
-      return XDG_MIME_TYPE_UNKNOWN;
-    }
-
-  bytes_read = fread (data, 1, max_extent, file);
-  if (ferror (file))
-    {
-      free (data);
-      fclose (file);
-      return XDG_MIME_TYPE_UNKNOWN;
-    }
 
   mime_type = cache_get_mime_type_for_data (data, bytes_read,
 					    mime_types, n);
 
-  free (data);
-  fclose (file);
-
   return mime_type;
 }
 
@@ -748,6 +718,14 @@ _xdg_mime_cache_get_mime_type_from_file_name (const char *file_name)
     return XDG_MIME_TYPE_UNKNOWN;
 }
 
+int
+_xdg_mime_cache_get_mime_types_from_file_name (const char *file_name,
+					       const char *mime_types[],
+					       int         n_mime_types)
+{
+  return cache_glob_lookup_file_name (file_name, mime_types, n_mime_types);
+}
+
 #if 1
 static int
 is_super_type (const char *mime)
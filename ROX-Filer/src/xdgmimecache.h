@@ -38,6 +38,7 @@ typedef struct _XdgMimeCache XdgMimeCache;
 #define _xdg_mime_cache_get_mime_type_for_data       XDG_RESERVED_ENTRY(mime_cache_get_mime_type_for_data)
 #define _xdg_mime_cache_get_mime_type_for_file       XDG_RESERVED_ENTRY(mime_cache_get_mime_type_for_file)
 #define _xdg_mime_cache_get_mime_type_from_file_name XDG_RESERVED_ENTRY(mime_cache_get_mime_type_from_file_name)
+#define _xdg_mime_cache_get_mime_types_from_file_name XDG_RESERVED_ENTRY(mime_cache_get_mime_types_from_file_name)
 #define _xdg_mime_cache_is_valid_mime_type           XDG_RESERVED_ENTRY(mime_cache_is_valid_mime_type)
 #define _xdg_mime_cache_mime_type_equal              XDG_RESERVED_ENTRY(mime_cache_mime_type_equal)
 #define _xdg_mime_cache_media_type_equal             XDG_RESERVED_ENTRY(mime_cache_media_type_equal)
@@ -60,6 +61,9 @@ const char  *_xdg_mime_cache_get_mime_type_for_data       (const void *data,
 const char  *_xdg_mime_cache_get_mime_type_for_file       (const char  *file_name,
 							   struct stat *statbuf);
 const char  *_xdg_mime_cache_get_mime_type_from_file_name (const char *file_name);
+int          _xdg_mime_cache_get_mime_types_from_file_name (const char *file_name,
+							    const char *mime_types[],
+							    int         n_mime_types);
 int          _xdg_mime_cache_is_valid_mime_type           (const char *mime_type);
 int          _xdg_mime_cache_mime_type_equal              (const char *mime_a,
 						           const char *mime_b);
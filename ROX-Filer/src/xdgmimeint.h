@@ -51,6 +51,7 @@ typedef unsigned int   xdg_uint32_t;
 #define _xdg_ucs4_to_lower   XDG_RESERVED_ENTRY(ucs4_to_lower)
 #define _xdg_utf8_validate   XDG_RESERVED_ENTRY(utf8_validate)
 #define _xdg_get_base_name   XDG_RESERVED_ENTRY(get_base_name)
+#define _xdg_mime_read_file_head XDG_RESERVED_ENTRY(mime_read_file_head)
 #endif
 
 #define SWAP_BE16_TO_LE16(val) (xdg_uint16_t)(((xdg_uint16_t)(val) << 8)|((xdg_uint16_t)(val) >> 8))
@@ -70,4 +71,10 @@ xdg_unichar_t  _xdg_ucs4_to_lower (xdg_unichar_t  source);
 int            _xdg_utf8_validate (const char    *source);
 const char    *_xdg_get_base_name (const char    *file_name);
 
+/* ROX: */
+const unsigned char *_xdg_mime_read_file_head (const char  *file_name,
+					       struct stat *statbuf,
+					       int          max_extent,
+					       int         *bytes_read);
+
 #endif /* __XDG_MIME_INT_H__ */
@@ -173,11 +173,54 @@ int xattr_set(const char *path, const char *attr,
 	return dyn_setxattr(path, attr, value, value_len, 0);
 }
 
+/* Copy all the extended attributes of 'from' to 'to'. 0 on success */
+int xattr_copy(const char *from, const char *to)
+{
+	ssize_t size, len;
+	gchar *names, *name, *value;
+	int result = 0;
+
+	RETURN_IF_IGNORED(0);
+
+	if (!dyn_listxattr || !dyn_getxattr || !dyn_setxattr)
+		return 0;
+
+	size = dyn_listxattr(from, NULL, 0);
+	if (size <= 0)
+		return 0;
+
+	names = g_new(gchar, size);
+	size = dyn_listxattr(from, names, size);
+
+	/* names is a list of nul-terminated strings */
+	for (name = names; size > 0 && name < names + size;
+	     name += strlen(name) + 1)
+	{
+		len = dyn_getxattr(from, name, NULL, 0);
+		if (len < 0)
+			continue;
+
+		value = g_new(gchar, len + 1);
+		len = dyn_getxattr(from, name, value, len);
+		if (len >= 0 && dyn_setxattr(to, name, value, len, 0))
+			result = 1;
+		g_free(value);
+	}
+
+	g_free(names);
+
+	return result;
+}
+
 
 #elif defined(HAVE_ATTROPEN)
 
 /* Solaris 9 implementation */
 
+#include <dirent.h>
+
+static int copy_attr(const char *from, const char *to, const char *attr);
+
 void xattr_init(void)
 {	
 	option_add_int(&o_xattr_ignore, "xattr_ignore", FALSE);
@@ -268,6 +311,85 @@ int xattr_set(const char *path, const char *attr,
 	return 1; /* Set type failed */
 }
 
+/* Copy all the extended attributes of 'from' to 'to'. 0 on success */
+int xattr_copy(const char *from, const char *to)
+{
+	int fd;
+	DIR *dir;
+	struct dirent *ent;
+	int result = 0;
+
+	RETURN_IF_IGNORED(0);
+
+#ifdef _PC_XATTR_EXISTS
+	if(pathconf(from, _PC_XATTR_EXISTS) <= 0)
+		return 0;
+#endif
+
+	/* The attributes are files in a hidden directory */
+	fd=attropen(from, ".", O_RDONLY);
+	if(fd<0)
+		return 1;
+
+#ifdef HAVE_FDOPENDIR
+	dir=fdopendir(fd);
+#else
+	dir=NULL;
+	errno=ENOSYS;
+#endif
+	if(!dir) {
+		close(fd);
+		return 1;
+	}
+
+	while((ent=readdir(dir))) {
+		/* Skip the system attribute views; they can't be copied */
+		if(strcmp(ent->d_name, ".")==0 ||
+		   strcmp(ent->d_name, "..")==0 ||
+		   strncmp(ent->d_name, "SUNWattr_", 9)==0)
+			continue;
+
+		if(copy_attr(from, to, ent->d_name))
+			result = 1;
+	}
+
+	closedir(dir);	/* (closes fd) */
+
+	return result;
+}
+
+/* Copy the contents of one extended attribute. 0 on success */
+static int copy_attr(const char *from, const char *to, const char *attr)
+{
+	int in, out;
+	char buf[BUFSIZ];
+	int nb;
+	int result = 0;
+
+	in=attropen(from, attr, O_RDONLY);
+	if(in<0)
+		return 1;
+
+	out=attropen(to, attr, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if(out<0) {
+		close(in);
+		return 1;
+	}
+
+	while((nb=read(in, buf, sizeof(buf)))!=0) {
+		if(nb<0 || write(out, buf, nb)!=nb) {
+			result = 1;
+			break;
+		}
+	}
+
+	close(in);
+	if(close(out))
+		result = 1;
+
+	return result;
+}
+
 #else
 /* No extended attributes available */
 
@@ -298,6 +420,11 @@ int xattr_set(const char *path, const char *attr,
 	return 1; /* Set type failed */
 }
 
+int xattr_copy(const char *from, const char *to)
+{
+	return 0;
+}
+
 #endif
 
 MIME_type *xtype_get(const char *path)
@@ -25,6 +25,7 @@ int xattr_have(const char *path);
 gchar *xattr_get(const char *path, const char *attr, int *len);
 int xattr_set(const char *path, const char *attr,
 	      const char *value, int value_len);
+int xattr_copy(const char *from, const char *to);
 
 MIME_type *xtype_get(const char *path);
 int xtype_set(const char *path, const MIME_type *type);